@@ -1,7 +1,7 @@
 #version 460 core
 out vec4 finalCol;
-uniform vec4 color;
+in vec4 fsColor;
 
 void main() {
-    finalCol = color;
+    finalCol = fsColor;
 }
@@ -1,10 +1,24 @@
 #version 460 core
 layout (location = 0) in vec3 vsPos;
+layout (location = 3) in vec4 instBody;
+layout (location = 4) in vec4 instColor;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+layout (std140, binding = 0) uniform Frame {
+    mat4 view;
+    mat4 proj;
+    vec4 pos;
+    vec4 rayLD, rayLU, rayRU, rayRD;
+    ivec2 extent;
+    int zone;
+    int nstars;
+    int nholes;
+    int pad0, pad1, pad2;
+};
+
+out vec4 fsColor;
 
 void main() {
-    gl_Position = proj * view * model * vec4(vsPos, 1.0);
+    vec3 worldPos = instBody.xyz + instBody.w * vsPos;
+    gl_Position = proj * view * vec4(worldPos, 1.0);
+    fsColor = instColor;
 }
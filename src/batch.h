@@ -0,0 +1,131 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <stdexcept>
+using namespace std;
+using namespace glm;
+
+// Headless rendering of a list of camera poses, selected with
+// `lens --batch <poses> [--out <dir>] [--size <w>x<h>] [--defl-series]
+// [--spin <s>] [--march <steps>] [--holes <n>] [--bounces <n>]
+// [--samples <n>] [--gpu [--defl-texture] [--reproject] [--compare-defl]]`,
+// where --spin sets the spin of the holes, --march integrates rays through
+// the holes' field with the given step budget per pixel, --holes places n
+// holes on a circle, --bounces sets how many influence spheres a ray may
+// enter, --samples averages n jittered rays per pixel and --reproject reuses
+// hits of the previous frame between nearby poses. --compare-defl renders
+// the poses once with the SSBO deflection table and once with the texture,
+// and reports both timings instead of writing frames.
+// Each non-empty line of the poses file not starting with '#' holds
+// `x y z yaw pitch zoom`.
+struct Pose {
+    vec3 pos;
+    float yaw, pitch, zoom;
+};
+
+struct BatchOptions {
+    string posesPath;
+    string outDir = ".";
+    int width = 800, height = 600;
+    bool gpu = false;
+    bool deflTexture = false;
+    bool compareDefl = false;
+    bool deflSeries = false;
+    float spin = 0;
+    int marchSteps = 0;
+    int holes = 1;
+    int maxBounces = 10;
+    int samples = 1;
+    bool reproject = false;
+
+    static bool requested(int argc, char **argv) {
+        for (int i = 1; i < argc; ++i) {
+            if (string(argv[i]) == "--batch") return true;
+        }
+        return false;
+    }
+
+    BatchOptions(int argc, char **argv) {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            auto next = [&]() -> string {
+                if (i + 1 >= argc)
+                    throw runtime_error("Missing value for " + arg + ".");
+                return argv[++i];
+            };
+
+            if (arg == "--batch") posesPath = next();
+            else if (arg == "--out") outDir = next();
+            else if (arg == "--gpu") gpu = true;
+            else if (arg == "--defl-texture") deflTexture = true;
+            else if (arg == "--compare-defl") compareDefl = true;
+            else if (arg == "--defl-series") deflSeries = true;
+            else if (arg == "--reproject") reproject = true;
+            else if (arg == "--spin") {
+                auto value = next();
+                if (sscanf(value.c_str(), "%f", &spin) != 1 || !(abs(spin) < 1))
+                    throw runtime_error("Invalid spin " + value + ".");
+            }
+            else if (arg == "--march") {
+                auto value = next();
+                if (sscanf(value.c_str(), "%d", &marchSteps) != 1 || marchSteps < 0)
+                    throw runtime_error("Invalid step budget " + value + ".");
+            }
+            else if (arg == "--holes") {
+                auto value = next();
+                if (sscanf(value.c_str(), "%d", &holes) != 1 || holes < 1)
+                    throw runtime_error("Invalid hole count " + value + ".");
+            }
+            else if (arg == "--bounces") {
+                auto value = next();
+                if (sscanf(value.c_str(), "%d", &maxBounces) != 1 || maxBounces < 1)
+                    throw runtime_error("Invalid bounce count " + value + ".");
+            }
+            else if (arg == "--samples") {
+                auto value = next();
+                if (sscanf(value.c_str(), "%d", &samples) != 1 || samples < 1)
+                    throw runtime_error("Invalid sample count " + value + ".");
+            }
+            else if (arg == "--size") {
+                auto size = next();
+                if (sscanf(size.c_str(), "%dx%d", &width, &height) != 2 ||
+                    width <= 0 || height <= 0)
+                    throw runtime_error("Invalid size " + size + ".");
+            }
+            else throw runtime_error("Unknown option " + arg + ".");
+        }
+    }
+
+    string framePath(int idx) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%05d.png", idx);
+        return outDir + name;
+    }
+};
+
+vector<Pose> loadPoses(string const& path) {
+    ifstream file(path);
+    if (!file)
+        throw runtime_error("Failed to open " + path + ".");
+
+    vector<Pose> poses;
+    string line;
+    for (int lineNo = 1; getline(file, line); ++lineNo) {
+        auto start = line.find_first_not_of(" \t\r");
+        if (start == string::npos || line[start] == '#') continue;
+
+        Pose pose = {};
+        istringstream ss(line);
+        if (!(ss >> pose.pos.x >> pose.pos.y >> pose.pos.z
+                 >> pose.yaw >> pose.pitch >> pose.zoom))
+            throw runtime_error(path + ":" + to_string(lineNo) + ": expected "
+                "x y z yaw pitch zoom.");
+        poses.push_back(pose);
+    }
+
+    return poses;
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <queue>
+#include <cstdint>
+using namespace std;
+using namespace glm;
+
+// Bounding volume hierarchy over spheres, flattened into an array of nodes
+// whose layout matches the std430 `Node` struct in res/raytracer.comp.
+// Children of an inner node are stored next to each other; leaves reference
+// a range of `indices`, which holds positions in the original sphere list.
+class BVH {
+public:
+    struct Node {
+        vec3 lo;
+        int32_t first;  // leaf: first entry in indices, inner: left child
+        vec3 hi;
+        int32_t count;  // leaf: number of entries, inner: -1
+    };
+
+    static constexpr int leafSize = 4;
+    static constexpr int maxDepth = 32;
+
+    vector<Node> nodes;
+    vector<int32_t> indices;
+    // Host-side links for refit(): the parent of each node, -1 for the
+    // root, and the leaf holding each sphere.
+    vector<int32_t> parents, leafOf;
+
+    BVH() = default;
+
+    // Spheres are given as (center, radius); entries at positions >= nstars
+    // have their radius scaled by holeScale, so that holes are indexed by
+    // their influence sphere rather than their horizon.
+    BVH(vector<vec4> const& spheres, int nstars, float holeScale) {
+        int n = spheres.size();
+        bounds(spheres, nstars, holeScale);
+
+        indices.resize(n);
+        for (int i = 0; i < n; ++i) indices[i] = i;
+
+        nodes.push_back({});
+        parents.push_back(-1);
+        leafOf.resize(n);
+        build(0, 0, n, 0);
+
+        lo.clear();
+        hi.clear();
+    }
+
+    // Recomputes the bounds of the leaves holding the given moved or resized
+    // spheres and of their ancestors, keeping the tree topology. Children
+    // always follow their parent in `nodes`, so visiting nodes from the back
+    // sees them before it. Returns the updated nodes in ascending order.
+    vector<int> refit(vector<vec4> const& spheres, vector<int> const& moved,
+            int nstars, float holeScale) {
+        priority_queue<int> queue;
+        for (int i: moved) queue.push(leafOf[i]);
+
+        vector<int> touched;
+        while (!queue.empty()) {
+            int n = queue.top();
+            queue.pop();
+            if (!touched.empty() && touched.back() == n) continue;
+            touched.push_back(n);
+
+            auto& node = nodes[n];
+            if (node.count >= 0) {
+                node.lo = vec3(INFINITY);
+                node.hi = vec3(-INFINITY);
+                for (int j = node.first; j < node.first + node.count; ++j) {
+                    int i = indices[j];
+                    float r = spheres[i].w * (i < nstars ? 1.0f : holeScale);
+                    node.lo = min(node.lo, vec3(spheres[i]) - vec3(r));
+                    node.hi = max(node.hi, vec3(spheres[i]) + vec3(r));
+                }
+            }
+            else {
+                auto const& l = nodes[node.first], & r = nodes[node.first + 1];
+                node.lo = min(l.lo, r.lo);
+                node.hi = max(l.hi, r.hi);
+            }
+
+            if (parents[n] >= 0) queue.push(parents[n]);
+        }
+
+        reverse(touched.begin(), touched.end());
+        return touched;
+    }
+
+private:
+    vector<vec3> lo, hi;
+
+    void bounds(vector<vec4> const& spheres, int nstars, float holeScale) {
+        int n = spheres.size();
+        lo.resize(n);
+        hi.resize(n);
+        for (int i = 0; i < n; ++i) {
+            float r = spheres[i].w * (i < nstars ? 1.0f : holeScale);
+            lo[i] = vec3(spheres[i]) - vec3(r);
+            hi[i] = vec3(spheres[i]) + vec3(r);
+        }
+    }
+
+    void build(int node, int first, int count, int depth) {
+        vec3 blo(INFINITY), bhi(-INFINITY), clo(INFINITY), chi(-INFINITY);
+        for (int i = first; i < first + count; ++i) {
+            int idx = indices[i];
+            blo = min(blo, lo[idx]);
+            bhi = max(bhi, hi[idx]);
+            vec3 c = (lo[idx] + hi[idx]) * 0.5f;
+            clo = min(clo, c);
+            chi = max(chi, c);
+        }
+
+        nodes[node].lo = blo;
+        nodes[node].hi = bhi;
+
+        // The traversal stack holds at most one entry per level.
+        if (count <= leafSize || depth + 1 >= maxDepth) {
+            nodes[node].first = first;
+            nodes[node].count = count;
+            for (int i = first; i < first + count; ++i) leafOf[indices[i]] = node;
+            return;
+        }
+
+        vec3 ext = chi - clo;
+        int axis = (ext.x > ext.y && ext.x > ext.z) ? 0 : (ext.y > ext.z ? 1 : 2);
+        int mid = first + count / 2;
+        nth_element(indices.begin() + first, indices.begin() + mid,
+            indices.begin() + first + count, [&](int a, int b) -> bool {
+                return lo[a][axis] + hi[a][axis] < lo[b][axis] + hi[b][axis];
+            });
+
+        int left = nodes.size();
+        nodes.push_back({});
+        nodes.push_back({});
+        parents.push_back(node);
+        parents.push_back(node);
+        nodes[node].first = left;
+        nodes[node].count = -1;
+
+        build(left, first, mid - first, depth + 1);
+        build(left + 1, mid, first + count - mid, depth + 1);
+    }
+};
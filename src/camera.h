@@ -47,6 +47,15 @@ public:
         return lookAt(pos, pos + front, up);
     }
 
+    void setPose(vec3 pos, float yaw, float pitch, float zoom) {
+        this->pos = pos;
+        this->yaw = yaw;
+        this->pitch = pitch;
+        this->zoom = zoom;
+
+        update();
+    }
+
     void onKeyPress(Movement mvmt, float dt) {
         auto dist = speed * dt;
         switch (mvmt) {
@@ -0,0 +1,397 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <vector>
+#include <cmath>
+#include "camera.h"
+#include "frame.h"
+#include "scene.h"
+#include "defl_table.h"
+#include "kerr.h"
+#include "parallel.h"
+using namespace std;
+using namespace glm;
+
+// CPU port of res/raytracer.comp. Renders the same image as the compute
+// shader, without a GL context, splitting the frame into tiles processed
+// by a pool of threads. Pixel (x, y) lands at index y * w + x, which matches
+// the memory layout of the texture written by the shader. Bodies changed
+// with Scene::updateBody() must be committed before rendering.
+class CpuRaytracer {
+private:
+    static constexpr int tileSize = 32;
+
+    Scene const *scene;
+    DeflTable const *table;
+    KerrTable const *kerrTable;
+
+    static float Rapx(float b) {
+        b *= 2;
+        float R = 3.01;
+        float priorR = 0;
+        float f, df;
+
+        for (int iter = 0; abs(R - priorR) >= 1e-5 && iter < 15; ++iter) {
+            priorR = R;
+            f = (R * R * R / (R - 2)) - b * b;
+            df = (2 * (R - 3) * R * R) / ((R - 2) * (R - 2));
+            R -= f / df;
+        }
+
+        R /= 2;
+        return R;
+    }
+
+    static float deflNear(float R) {
+        R *= 2;
+        float b = sqrt(R * R * R / (R - 2));
+        return -log(b / (3 * sqrt(3.0f)) - 1) - 0.40023f;
+    }
+
+    static float deflFar(float R) {
+        return 2 / R;
+    }
+
+    static float deflWeak(float b) {
+        float u = 1 / b;
+        return u * (2.0f + u * (2.9452431f + u * (5.3333333f
+            + u * (10.630487f + u * (22.4f + u * 48.944533f)))));
+    }
+
+    static float deflStrong(float b) {
+        float x = b / DeflTable::bCrit - 1, l = log(x);
+        return -l - 0.40023004f + x * (-0.2752835f * l + 1.2154237f
+            + x * (0.1951111f * l - 0.2222020f + x * -0.0361186f));
+    }
+
+    float defl(float b) const {
+        if (deflSeries) {
+            return b < (float)grav::seriesSplit ? deflStrong(b) : deflWeak(b);
+        }
+
+        auto const& t = *table;
+        if (b < t.lowCutoff) {
+            return deflNear(Rapx(b));
+        }
+        else if (b < t.highCutoff) {
+            return t.lookup(b);
+        }
+        else {
+            return deflFar(Rapx(b));
+        }
+    }
+
+    static float intersection(vec3 c, vec3 r, float R) {
+        float d = dot(r, c);
+        float del = d * d - dot(c, c) + R * R;
+        if (del < 0) {
+            return -1;
+        }
+
+        float best = -1;
+        float del_sqrt = sqrt(del);
+
+        float lam = d - del_sqrt;
+        if (lam > 0 && (best < 0 || lam < best)) {
+            best = lam;
+        }
+
+        lam = d + del_sqrt;
+        if (lam > 0 && (best < 0 || lam < best)) {
+            best = lam;
+        }
+
+        return best;
+    }
+
+    static float boxEntry(vec3 lo, vec3 hi, vec3 p, vec3 invR) {
+        vec3 t0 = (lo - p) * invR, t1 = (hi - p) * invR;
+        vec3 tmin = min(t0, t1), tmax = max(t0, t1);
+        float tnear = max(max(tmin.x, tmin.y), max(tmin.z, 0.0f));
+        float tfar = min(min(tmax.x, tmax.y), tmax.z);
+        return tnear <= tfar ? tnear : -1;
+    }
+
+    int closestBody(vec3 p, vec3 r, int nstars, float maxT, bool starsOnly, float& best) const {
+        auto const& bodies = scene->buffer;
+        auto const& bvh = scene->bvh;
+
+        vec3 invR;
+        for (int j = 0; j < 3; ++j) {
+            invR[j] = 1.0f / (abs(r[j]) < 1e-20f ? 1e-20f : r[j]);
+        }
+
+        int stack[BVH::maxDepth];
+        int top = 0;
+        stack[top++] = 0;
+
+        best = -1;
+        int best_i = -1;
+        while (top > 0) {
+            auto const& node = bvh.nodes[stack[--top]];
+            float t = boxEntry(node.lo, node.hi, p, invR);
+            if (t < 0 || t > maxT || (best >= 0 && t > best)) continue;
+
+            if (node.count >= 0) {
+                for (int j = node.first; j < node.first + node.count; ++j) {
+                    int i = bvh.indices[j];
+                    if (starsOnly && i >= nstars) continue;
+
+                    float R = i < nstars ? bodies[i].w : Scene::holeInfluence * bodies[i].w;
+                    float lam = intersection(vec3(bodies[i]) - p, r, R);
+                    if (lam > 0 && lam <= maxT && (best < 0 || lam < best)) {
+                        best = lam;
+                        best_i = i;
+                    }
+                }
+            }
+            else {
+                stack[top++] = node.first;
+                stack[top++] = node.first + 1;
+            }
+        }
+
+        return best_i;
+    }
+
+    static float minDist(vec3 c, vec3 r) {
+        return length(r * dot(r, c) - c);
+    }
+
+    static vec3 rotate(vec3 v, vec3 k, float theta) {
+        return v * cos(theta) + cross(k, v) * sin(theta) + k * dot(k, v) * (1 - cos(theta));
+    }
+
+    // Acceleration of a marched ray, summed over every hole whose influence
+    // sphere contains x, along with the closest of them, like the shader.
+    vec3 field(vec3 x, vec3 v, int nstars, int& hole, float& dist) const {
+        auto const& bodies = scene->buffer;
+        auto const& bvh = scene->bvh;
+
+        int stack[BVH::maxDepth];
+        int top = 0;
+        stack[top++] = 0;
+
+        vec3 a(0);
+        hole = -1;
+        dist = 1e30f;
+        while (top > 0) {
+            auto const& node = bvh.nodes[stack[--top]];
+            if (glm::any(glm::lessThan(x, node.lo)) || glm::any(glm::greaterThan(x, node.hi))) continue;
+
+            if (node.count >= 0) {
+                for (int j = node.first; j < node.first + node.count; ++j) {
+                    int i = bvh.indices[j];
+                    if (i < nstars) continue;
+
+                    vec3 d = x - vec3(bodies[i]);
+                    float r2 = dot(d, d);
+                    float R = Scene::holeInfluence * bodies[i].w;
+                    if (r2 >= R * R) continue;
+
+                    vec3 L = cross(d, v);
+                    a -= 1.5f * bodies[i].w * dot(L, L) * d / (r2 * r2 * sqrt(r2));
+
+                    float di = sqrt(r2) / bodies[i].w;
+                    if (di < dist) {
+                        dist = di;
+                        hole = i;
+                    }
+                }
+            }
+            else {
+                stack[top++] = node.first;
+                stack[top++] = node.first + 1;
+            }
+        }
+
+        return a;
+    }
+
+    vec3 accel(vec3 x, vec3 v, int nstars) const {
+        int hole;
+        float dist;
+        return field(x, v, nstars, hole, dist);
+    }
+
+    // Steps of marching per pixel, or 0 to deflect; scenes with overlapping
+    // influence spheres are always marched, see Scene::holesOverlap().
+    int stepBudget() const {
+        if (marchSteps > 0 || !scene->holesOverlap()) return marchSteps;
+        return Scene::overlapMarchSteps;
+    }
+
+    // Both tracing modes return the ray's final direction and the index of
+    // the body it ends on, -1 for the background.
+    vec4 march(vec3 p, vec3 r, FrameConstants const& f) const {
+        auto const& bodies = scene->buffer;
+        int budget = stepBudget();
+
+        float best;
+        int steps = 0;
+
+        for (int pass = 0; pass < maxBounces; ++pass) {
+            bool spent = steps >= budget;
+            int best_i = closestBody(p, r, f.nstars, 1e30f, spent, best);
+            if (best_i < 0) {
+                return vec4(r, -1);
+            }
+            if (best_i < f.nstars || zone) {
+                return vec4(r, best_i);
+            }
+            p += (best + 1e-3f * bodies[best_i].w) * r;
+
+            for (; steps < budget; ++steps) {
+                int hole;
+                float d;
+                vec3 k1v = field(p, r, f.nstars, hole, d);
+                if (hole < 0) {
+                    break;
+                }
+                if (d < 1) {
+                    return vec4(r, hole);
+                }
+
+                float ds = marchStepScale * d * bodies[hole].w;
+                best_i = closestBody(p, r, f.nstars, ds, true, best);
+                if (best_i >= 0) {
+                    return vec4(r, best_i);
+                }
+
+                vec3 k1x = r;
+                vec3 k2x = r + ds / 2 * k1v, k2v = accel(p + ds / 2 * k1x, k2x, f.nstars);
+                vec3 k3x = r + ds / 2 * k2v, k3v = accel(p + ds / 2 * k2x, k3x, f.nstars);
+                vec3 k4x = r + ds * k3v, k4v = accel(p + ds * k3x, k4x, f.nstars);
+                p += ds / 6 * (k1x + 2.0f * k2x + 2.0f * k3x + k4x);
+                r = normalize(r + ds / 6 * (k1v + 2.0f * k2v + 2.0f * k3v + k4v));
+            }
+        }
+
+        return vec4(r, -1);
+    }
+
+    vec4 shade(vec4 hit) const {
+        int hitId = (int)hit.w;
+        return hitId < 0 ? vec4(bgColor, 1.0) : scene->colorBuffer[hitId];
+    }
+
+    vec4 trace(ivec2 pix, vec2 jitter, FrameConstants const& f) const {
+        auto const& bodies = scene->buffer;
+        auto const& spins = scene->spinBuffer;
+
+        float x = ((float)pix.x + jitter.x) / (float)f.extent.x;
+        float y = ((float)pix.y + jitter.y) / (float)f.extent.y;
+        vec3 rayLD(f.rayLD), rayRD(f.rayRD), rayLU(f.rayLU);
+        vec3 ray = rayLD + (rayRD - rayLD) * x + (rayLU - rayLD) * (1 - y);
+
+        vec3 p = ray;
+        vec3 r = normalize(ray - vec3(f.pos));
+
+        if (stepBudget() > 0) {
+            return march(p, r, f);
+        }
+
+        float best;
+        int best_i = 0;
+        int hitId = -1;
+        vec3 c;
+        float R = 0, spin = 0;
+        int hit;
+
+        for (int iter = 0; iter < maxBounces; ++iter) {
+            best_i = closestBody(p, r, f.nstars, 1e30f, false, best);
+            hit = best_i < 0 ? 0 : (best_i < f.nstars ? 1 : 2);
+            if (hit == 2) {
+                c = vec3(bodies[best_i]);
+                R = bodies[best_i].w;
+                spin = kerrTable ? spins[best_i] : 0;
+            }
+
+            if (hit == 0) {
+                hitId = -1;
+                break;
+            }
+            if (hit == 1) {
+                hitId = best_i;
+                break;
+            }
+            else {
+                p += best * r;
+                float b = minDist(c - p, r) / (R * sqrt(1.0f - R / best));
+
+                vec3 L = cross(p - c, r);
+                float s = spin * L.y / std::max(length(L), 1e-20f);
+                float bCrit = spin == 0 ? 1.5f * sqrt(3.0f) : KerrTable::bCrit(s);
+
+                if (b < bCrit || zone) {
+                    hitId = best_i;
+                    break;
+                }
+                else {
+                    float dir = dot(r, c - p);
+                    if (dir >= 0) {
+                        float theta = spin == 0 ? defl(b) : kerrTable->lookup(b, s);
+                        float psi = acos(dir / length(c - p));
+                        float phi = (float)M_PI + theta - 2 * psi;
+
+                        vec3 k = normalize(cross(r, c - p));
+                        r = normalize(rotate(r, k, theta));
+                        p = c + rotate(p - c, k, phi);
+                    }
+                    p += 0.01f * r;
+                }
+            }
+        }
+
+        return vec4(r, hitId);
+    }
+
+public:
+    vec3 bgColor = vec3(0.1);
+    bool zone = false;
+    // Number of times a ray may enter an influence sphere.
+    int maxBounces = 10;
+    // Use the series kernels everywhere instead of the table.
+    bool deflSeries = false;
+    // Integrate rays through the holes' field instead, with at most this
+    // many steps per pixel, each marchStepScale times the distance to the
+    // closest hole. 0 disables marching, unless the scene needs it.
+    int marchSteps = 0;
+    float marchStepScale = 0.05f;
+
+    // Without a Kerr table, all holes are treated as non-rotating.
+    CpuRaytracer(Scene const *scene, DeflTable const *table,
+            KerrTable const *kerrTable = nullptr) {
+        this->scene = scene;
+        this->table = table;
+        this->kerrTable = kerrTable;
+    }
+
+    // Mean of `samples` rays per pixel, jittered as in progressive GPU
+    // rendering; see jitterOffset().
+    vector<vec4> render(Camera const& camera, int w, int h, int samples = 1) const {
+        FrameConstants f(camera, w, h);
+        f.nstars = scene->stars.size();
+        f.nholes = scene->holes.size();
+
+        vector<vec4> image(w * h);
+        int tilesX = (w + tileSize - 1) / tileSize;
+        int tilesY = (h + tileSize - 1) / tileSize;
+
+        parallelFor(tilesX * tilesY, [&](int tile) -> void {
+            int x0 = (tile % tilesX) * tileSize, y0 = (tile / tilesX) * tileSize;
+            int x1 = min(x0 + tileSize, w), y1 = min(y0 + tileSize, h);
+            for (int y = y0; y < y1; ++y) {
+                for (int x = x0; x < x1; ++x) {
+                    vec4 sum(0);
+                    for (int s = 0; s < samples; ++s) {
+                        sum += shade(trace(ivec2(x, y), jitterOffset(s), f));
+                    }
+                    image[y * w + x] = sum / (float)samples;
+                }
+            }
+        });
+
+        return image;
+    }
+};
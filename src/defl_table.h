@@ -0,0 +1,154 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include "rayapx.h"
+#include "mapped_file.h"
+using namespace std;
+
+// Tabulated deflection angles for impact parameters between lowCutoff and
+// highCutoff. Samples are spaced uniformly in log(b - bCrit), which puts most
+// of them near the photon sphere, where the deflection diverges
+// logarithmically and is close to linear in that coordinate; lookups
+// interpolate linearly between neighbouring samples. Shared by the compute
+// shader (uploaded as an SSBO) and the CPU raytracer.
+//
+// The tables can be persisted in a binary cache file, which is memory-mapped
+// on load and only regenerated when the parameters stored in its header do
+// not match the requested ones.
+class DeflTable {
+private:
+    static constexpr uint32_t cacheVersion = 2;
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        float lowCutoff, highCutoff;
+        int32_t res;
+    };
+
+    vector<float> storage;
+    MappedFile file;
+    float t0 = 0, dt = 1;
+
+    void updateCoords() {
+        t0 = log(lowCutoff - bCrit);
+        dt = (log(highCutoff - bCrit) - t0) / (float)(res - 1);
+    }
+
+    Header header() const {
+        Header hdr = {};
+        memcpy(hdr.magic, "DEFL", 4);
+        hdr.version = cacheVersion;
+        hdr.lowCutoff = lowCutoff;
+        hdr.highCutoff = highCutoff;
+        hdr.res = res;
+        return hdr;
+    }
+
+    bool map(string const& cachePath) {
+        auto mapped = MappedFile(cachePath.c_str());
+        size_t nbytes = sizeof(Header) + res * sizeof(float);
+        if (!mapped || mapped.size() != nbytes) return false;
+
+        auto expected = header();
+        if (memcmp(mapped.data(), &expected, sizeof(Header)) != 0) return false;
+
+        file = move(mapped);
+        storage.clear();
+        updateCoords();
+        values = (const float*)(file.data() + sizeof(Header));
+        return true;
+    }
+
+    // Writes to a temporary file private to this process first, so that
+    // concurrent writers never share one and readers only map whole files.
+    // Failures are only reported: the table stays usable without a cache.
+    void save(string const& cachePath) const {
+        auto tmpPath = cachePath + "." + to_string(getpid()) + ".tmp";
+        bool written;
+        {
+            ofstream out(tmpPath, ios::binary | ios::trunc);
+            auto hdr = header();
+            out.write((const char*)&hdr, sizeof(Header));
+            out.write((const char*)storage.data(), storage.size() * sizeof(float));
+            out.close();
+            written = (bool)out;
+        }
+
+        if (!written || rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+            remove(tmpPath.c_str());
+            cerr << "lens: could not write the deflection cache " << cachePath << '\n';
+        }
+    }
+
+public:
+    static constexpr float bCrit = 2.598076211f;
+
+    float lowCutoff = 2.5985;
+    float highCutoff = 10;
+    int res = 512;
+
+    const float *values = nullptr;
+
+    static constexpr const char *defaultCachePath = "defl.cache";
+
+    DeflTable() {
+        compute();
+    }
+
+    explicit DeflTable(string const& cachePath) {
+        load(cachePath);
+    }
+
+    DeflTable(const DeflTable&) = delete;
+    DeflTable& operator=(const DeflTable&) = delete;
+
+    // Coordinate of the first sample, log(lowCutoff - bCrit), and the spacing
+    // between samples; passed to the shader as uniforms.
+    float logLow() const {
+        return t0;
+    }
+
+    float logStep() const {
+        return dt;
+    }
+
+    // Interpolated deflection for lowCutoff <= b < highCutoff.
+    float lookup(float b) const {
+        float x = (log(b - bCrit) - t0) / dt;
+        int idx = min(max((int)x, 0), res - 2);
+        float frac = x - (float)idx;
+        return values[idx] + (values[idx + 1] - values[idx]) * frac;
+    }
+
+    void compute() {
+        storage.resize(res);
+        file = MappedFile();
+        values = storage.data();
+        updateCoords();
+
+        vector<double> bs(res);
+        for (int i = 0; i < res; ++i) {
+            bs[i] = bCrit + exp((double)t0 + i * (double)dt);
+        }
+
+        grav::deflOfB(bs.data(), storage.data(), bs.size());
+    }
+
+    // Maps the cache file if it matches the current parameters; otherwise
+    // recomputes the tables and rewrites the cache. A cache that cannot be
+    // written is not an error, the tables are then just kept in memory.
+    void load(string const& cachePath) {
+        if (map(cachePath)) return;
+
+        compute();
+        save(cachePath);
+        map(cachePath);
+    }
+};
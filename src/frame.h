@@ -0,0 +1,54 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "camera.h"
+using namespace glm;
+
+// Per-frame constants, shared by all programs through the std140 `Frame`
+// uniform block at binding 0. Fields are ordered so that the C++ layout
+// coincides with std140 and the struct can be uploaded as is; the padding
+// rounds it up to the 16 bytes drivers round block sizes to.
+struct FrameConstants {
+    mat4 view, proj;
+    vec4 pos;
+    vec4 rayLD, rayLU, rayRU, rayRD;
+    ivec2 extent;
+    int zone, nstars, nholes;
+    int pad[3];
+
+    FrameConstants() = default;
+
+    // Corner rays are the near-plane points of the view frustum.
+    FrameConstants(Camera const& camera, int w, int h) {
+        view = camera.view();
+        proj = camera.proj(w, h);
+        pos = vec4(camera.pos, 1);
+        extent = ivec2(w, h);
+        zone = nstars = nholes = 0;
+        pad[0] = pad[1] = pad[2] = 0;
+
+        vec4 viewport(0, 0, w, h);
+        rayLD = vec4(unProject(vec3(0, 0, -1), view, proj, viewport), 1);
+        rayLU = vec4(unProject(vec3(0, h, -1), view, proj, viewport), 1);
+        rayRU = vec4(unProject(vec3(w, h, -1), view, proj, viewport), 1);
+        rayRD = vec4(unProject(vec3(w, 0, -1), view, proj, viewport), 1);
+    }
+};
+
+static_assert(sizeof(FrameConstants) == 240, "FrameConstants must match std140");
+
+// Offset within the pixel, in pixels, of the i-th sample of progressive
+// rendering: the (2, 3) Halton sequence, which starts at the pixel's corner
+// like single-sample frames and fills the pixel evenly at any sample count.
+inline vec2 jitterOffset(int i) {
+    vec2 offset(0);
+    int bases[2] = { 2, 3 };
+    for (int j = 0; j < 2; ++j) {
+        float f = 1;
+        for (int k = i; k > 0; k /= bases[j]) {
+            f /= bases[j];
+            offset[j] += f * (k % bases[j]);
+        }
+    }
+    return offset;
+}
@@ -0,0 +1,414 @@
+#pragma once
+#include <Eigen/Eigen>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+#include "parallel.h"
+using namespace Eigen;
+using namespace std;
+
+namespace geodesic {
+    // Photon orbit around a Schwarzschild hole, in the plane spanned by the
+    // hole and the initial ray. The orbit is described by u = Rs / r as a
+    // function of the angle phi swept from the starting point, and obeys
+    // u'' = -u (1 - 1.5 u).
+    struct Orbit {
+        Vector3d h, k, ray;
+        double Rs;
+        double u0, du0;
+
+        // World position at (u, phi): the starting direction rotated by phi
+        // about k.
+        Vector3d at(double u, double phi) const {
+            Vector3d vrot = ray * cos(phi) +
+                            k.cross(ray) * sin(phi) +
+                            k * k.dot(ray) * (1.0 - cos(phi));
+            return h + (Rs / u) * vrot;
+        }
+    };
+
+    // Embedded Dormand-Prince 5(4) step for u'' = -u (1 - 1.5 u), written
+    // once for plain doubles and for Eigen arrays of lanes. Produces the
+    // fifth-order solution and the error norm relative to the tolerances;
+    // err <= 1 means the step is acceptable.
+    constexpr double rtol = 1e-8, atol = 1e-10;
+    constexpr double hmin = 1e-12, hmax = 0.1, hinit = 0.01;
+    constexpr int maxSteps = 100000;
+
+    inline double vabs(double x) { return std::abs(x); }
+    inline double vmax(double x, double y) { return std::max(x, y); }
+
+    template<typename D>
+    auto vabs(ArrayBase<D> const& x) { return x.abs().eval(); }
+
+    template<typename D>
+    auto vmax(ArrayBase<D> const& x, ArrayBase<D> const& y) { return x.max(y).eval(); }
+
+    template<typename T>
+    void step(T const& u, T const& du, T const& h, T& u5, T& du5, T& err) {
+        auto g = [](T const& u) -> T { return -u * (1.0 - 1.5 * u); };
+
+        T k1u = du, k1d = g(u);
+        T k2u = du + h * (k1d / 5.0);
+        T k2d = g(u + h * (k1u / 5.0));
+        T k3u = du + h * (3.0 / 40.0 * k1d + 9.0 / 40.0 * k2d);
+        T k3d = g(u + h * (3.0 / 40.0 * k1u + 9.0 / 40.0 * k2u));
+        T k4u = du + h * (44.0 / 45.0 * k1d - 56.0 / 15.0 * k2d + 32.0 / 9.0 * k3d);
+        T k4d = g(u + h * (44.0 / 45.0 * k1u - 56.0 / 15.0 * k2u + 32.0 / 9.0 * k3u));
+        T k5u = du + h * (19372.0 / 6561.0 * k1d - 25360.0 / 2187.0 * k2d
+            + 64448.0 / 6561.0 * k3d - 212.0 / 729.0 * k4d);
+        T k5d = g(u + h * (19372.0 / 6561.0 * k1u - 25360.0 / 2187.0 * k2u
+            + 64448.0 / 6561.0 * k3u - 212.0 / 729.0 * k4u));
+        T k6u = du + h * (9017.0 / 3168.0 * k1d - 355.0 / 33.0 * k2d
+            + 46732.0 / 5247.0 * k3d + 49.0 / 176.0 * k4d - 5103.0 / 18656.0 * k5d);
+        T k6d = g(u + h * (9017.0 / 3168.0 * k1u - 355.0 / 33.0 * k2u
+            + 46732.0 / 5247.0 * k3u + 49.0 / 176.0 * k4u - 5103.0 / 18656.0 * k5u));
+
+        u5 = u + h * (35.0 / 384.0 * k1u + 500.0 / 1113.0 * k3u + 125.0 / 192.0 * k4u
+            - 2187.0 / 6784.0 * k5u + 11.0 / 84.0 * k6u);
+        du5 = du + h * (35.0 / 384.0 * k1d + 500.0 / 1113.0 * k3d + 125.0 / 192.0 * k4d
+            - 2187.0 / 6784.0 * k5d + 11.0 / 84.0 * k6d);
+        T k7u = du5, k7d = g(u5);
+
+        // Difference between the fifth- and the embedded fourth-order result.
+        T eu = h * (71.0 / 57600.0 * k1u - 71.0 / 16695.0 * k3u + 71.0 / 1920.0 * k4u
+            - 17253.0 / 339200.0 * k5u + 22.0 / 525.0 * k6u - 1.0 / 40.0 * k7u);
+        T ed = h * (71.0 / 57600.0 * k1d - 71.0 / 16695.0 * k3d + 71.0 / 1920.0 * k4d
+            - 17253.0 / 339200.0 * k5d + 22.0 / 525.0 * k6d - 1.0 / 40.0 * k7d);
+
+        err = vmax(T(vabs(eu) / (atol + rtol * vabs(u5))),
+                   T(vabs(ed) / (atol + rtol * vabs(du5))));
+    }
+
+    // Step size for the next attempt from the error norm of the last one.
+    template<typename T>
+    T nextStep(T const& h, T const& err) {
+        if constexpr (std::is_same_v<T, double>) {
+            double factor = 0.9 * pow(std::max(err, 1e-10), -0.2);
+            return std::clamp(h * std::clamp(factor, 0.2, 5.0), hmin, hmax);
+        }
+        else {
+            T factor = 0.9 * err.max(1e-10).pow(-0.2);
+            return (h * factor.max(0.2).min(5.0)).max(hmin).min(hmax);
+        }
+    }
+
+    // Length of the step from (u, du) that lands exactly on u = ue, given a
+    // step h that overshoots it, by secant iterations; the state at the end
+    // of that step is left in u5, du5.
+    double stepTo(double u, double du, double ue, double h, double& u5, double& du5) {
+        double err, h0 = 0, f0 = u - ue;
+        step(u, du, h, u5, du5, err);
+        double f1 = u5 - ue;
+        for (int iter = 0; iter < 32 && std::abs(f1) > 1e-15 && f1 != f0; ++iter) {
+            double h2 = h - f1 * (h - h0) / (f1 - f0);
+            h0 = h;
+            f0 = f1;
+            h = h2;
+            step(u, du, h, u5, du5, err);
+            f1 = u5 - ue;
+        }
+        return h;
+    }
+
+    // Orbit of a photon leaving p in the (unit) direction r, around a hole
+    // at h with Schwarzschild radius Rs.
+    Orbit makeOrbit(Vector3d const& p, Vector3d const& r, Vector3d const& h,
+            double Rs) {
+        Orbit orbit;
+        Vector3d d = h - p;
+        orbit.h = h;
+        orbit.k = r.cross(d).normalized();
+        orbit.ray = -d.normalized();
+        orbit.Rs = Rs;
+
+        double R = d.norm() / Rs;
+        double u = 1.0 / R;
+        double cosAlpha = d.dot(r) / d.norm();
+        double sinAlpha = sqrt(1.0 - cosAlpha * cosAlpha);
+        double b = (R * sinAlpha) / sqrt(1.0 - 1.0 / R);
+        double du2 = 1.0 / (b * b) - (1.0 - u) * u * u;
+
+        orbit.u0 = u;
+        orbit.du0 = sqrt(du2);
+        return orbit;
+    }
+
+    // Integrates many orbits at once. Each thread advances a fixed number of
+    // lanes together, one orbit per lane in structure-of-arrays form, with
+    // the adaptive scheme of Ray::makePath and a step size per lane; when an
+    // orbit ends, its lane is refilled with the next pending one so that the
+    // vector units stay busy. Returns one polyline per orbit, ending when the
+    // photon crosses the horizon or on the sphere of radius `far` around the
+    // hole.
+    vector<vector<glm::vec3>> integrate(vector<Orbit> const& orbits, double far) {
+        static constexpr int lanes = 8;
+        using Lanes = Array<double, lanes, 1>;
+        using Mask = Array<bool, lanes, 1>;
+
+        int n = orbits.size();
+        vector<vector<glm::vec3>> paths(n);
+        atomic<int> next = 0;
+
+        parallelFor(workerCount(), [&](int) -> void {
+            int idx[lanes];
+            Lanes u = Lanes::Ones(), du = Lanes::Zero(), phi = Lanes::Zero();
+            Lanes Rs = Lanes::Ones(), delta = Lanes::Constant(hinit);
+            Lanes newU, newDu, err;
+            int nsteps[lanes] = {};
+            Mask active = Mask::Constant(false), pending;
+
+            // Orbit frames, so that vertex positions are also computed for
+            // all lanes at once: h + (Rs / u) (a cos(phi) + b sin(phi)).
+            // The k (k . ray) term of the rotation vanishes since k is
+            // normal to ray.
+            using Frame = Matrix<double, lanes, 3>;
+            Frame h = Frame::Zero(), a = Frame::Zero(), b = Frame::Zero();
+
+            while (true) {
+                for (int i = 0; i < lanes; ++i) {
+                    if (active[i]) {
+                        double rad = Rs[i] / u[i];
+                        active[i] = rad > Rs[i] && rad <= far && nsteps[i] < maxSteps;
+                    }
+
+                    while (!active[i]) {
+                        int j = next++;
+                        if (j >= n) break;
+
+                        auto const& orbit = orbits[j];
+                        idx[i] = j;
+                        u[i] = orbit.u0;
+                        du[i] = orbit.du0;
+                        phi[i] = 0;
+                        delta[i] = hinit;
+                        nsteps[i] = 0;
+                        Rs[i] = orbit.Rs;
+                        h.row(i) = orbit.h.transpose();
+                        a.row(i) = orbit.ray.transpose();
+                        b.row(i) = orbit.k.cross(orbit.ray).transpose();
+
+                        double rad = Rs[i] / u[i];
+                        active[i] = rad > Rs[i] && rad <= far;
+                    }
+                }
+
+                Lanes scale = Rs / u, c = scale * phi.cos(), s = scale * phi.sin();
+                Frame pos = h + (a.array().colwise() * c +
+                    b.array().colwise() * s).matrix();
+                for (int i = 0; i < lanes; ++i) {
+                    if (active[i]) {
+                        paths[idx[i]].emplace_back(pos(i, 0), pos(i, 1), pos(i, 2));
+                    }
+                }
+
+                if (!active.any()) break;
+
+                pending = active;
+                while (pending.any()) {
+                    step<Lanes>(u, du, delta, newU, newDu, err);
+
+                    Mask accept = pending && (err <= 1.0 || delta <= hmin);
+
+                    // A step that leaves the sphere of radius far is cut
+                    // short to end on it, and the orbit ends there.
+                    for (int i = 0; i < lanes; ++i) {
+                        double ue = Rs[i] / far;
+                        if (!accept[i] || newU[i] >= ue) continue;
+
+                        double u5, du5;
+                        double taken = stepTo(u[i], du[i], ue, delta[i], u5, du5);
+                        Vector3d pos = orbits[idx[i]].at(ue, phi[i] + taken);
+                        paths[idx[i]].emplace_back(pos.x(), pos.y(), pos.z());
+                        accept[i] = pending[i] = active[i] = false;
+                    }
+
+                    u = accept.select(newU, u);
+                    du = accept.select(newDu, du);
+                    phi = accept.select(phi + delta, phi);
+
+                    pending = pending && !accept;
+                    delta = active.select(nextStep<Lanes>(delta, err), delta);
+                }
+
+                for (int i = 0; i < lanes; ++i) nsteps[i] += active[i];
+            }
+        });
+
+        return paths;
+    }
+
+    // Jacobi elliptic function sn(x, k), by descending Landen transformation.
+    double jacobiSn(double x, double k) {
+        double mc = 1.0 - k * k;
+        if (mc <= 0) return tanh(x);
+
+        double em[16], en[16], a = 1, c = 1, dn = 1;
+        int l = 0;
+        for (int i = 0; i < 16; ++i) {
+            l = i;
+            em[i] = a;
+            en[i] = mc = sqrt(mc);
+            c = 0.5 * (a + mc);
+            if (std::abs(a - mc) <= 1e-9 * a) break;
+            mc *= a;
+            a = c;
+        }
+
+        x *= c;
+        double sn = sin(x), cn = cos(x);
+        if (sn == 0) return 0;
+
+        a = cn / sn;
+        c *= a;
+        for (int i = l; i >= 0; --i) {
+            double b = em[i];
+            a *= c;
+            c *= dn;
+            dn = (en[i] + a) / (b + a);
+            a = c / b;
+        }
+
+        a = 1.0 / sqrt(c * c + 1.0);
+        return sn >= 0 ? a : -a;
+    }
+
+    // Closed-form orbit. With 1 / b^2 = du^2 + (1 - u) u^2, the orbit obeys
+    // du^2 = (u - u1) (u - u2) (u - u3), whose roots u1 < 0 < u2 < u3 are
+    // real for b > bCrit, and then
+    //   u(phi) = u1 + (u2 - u1) sn^2(gamma phi + x0, k),
+    // with k^2 = (u2 - u1) / (u3 - u1) and gamma = sqrt(u3 - u1) / 2. The
+    // photon reaches periapsis u2 when the argument equals K(k) and leaves
+    // symmetrically, so any phi can be evaluated directly.
+    struct ClosedOrbit {
+        double u1, u2, k, gamma, x0, K;
+
+        double u(double phi) const {
+            double sn = jacobiSn(gamma * phi + x0, k);
+            return u1 + (u2 - u1) * sn * sn;
+        }
+
+        // Angle at which the outgoing photon gets back to u = ue.
+        double exit(double ue) const {
+            double s = std::clamp((ue - u1) / (u2 - u1), 0.0, 1.0);
+            return (2 * K - std::ellint_1(k, asin(sqrt(s))) - x0) / gamma;
+        }
+    };
+
+    // Fails for captured photons (b <= bCrit) and for ones starting inside
+    // the photon sphere, for which the numeric integrator has to be used.
+    bool closedForm(Orbit const& orbit, ClosedOrbit& out) {
+        double u0 = orbit.u0, du0 = orbit.du0;
+        double c = du0 * du0 + (1.0 - u0) * u0 * u0;
+        if (!(c < 4.0 / 27.0)) return false;
+
+        // Trigonometric solution of u^3 - u^2 + c = 0.
+        double theta = acos(1.0 - 13.5 * c);
+        double u3 = 1.0 / 3.0 + 2.0 / 3.0 * cos(theta / 3.0);
+        double u2 = 1.0 / 3.0 + 2.0 / 3.0 * cos((theta - 2 * M_PI) / 3.0);
+        double u1 = 1.0 / 3.0 + 2.0 / 3.0 * cos((theta - 4 * M_PI) / 3.0);
+        if (u0 > u2) return false;
+
+        out.u1 = u1;
+        out.u2 = u2;
+        out.k = sqrt((u2 - u1) / (u3 - u1));
+        out.gamma = sqrt(u3 - u1) / 2.0;
+        out.K = std::comp_ellint_1(out.k);
+
+        double s = std::clamp((u0 - u1) / (u2 - u1), 0.0, 1.0);
+        double x0 = std::ellint_1(out.k, asin(sqrt(s)));
+        out.x0 = du0 >= 0 ? x0 : -x0;
+        return true;
+    }
+
+    // Samples an orbit in closed form until the photon gets further than
+    // `far` from the hole, at the largest step the integrator would take.
+    // Returns false, leaving verts empty, if the orbit has no closed form.
+    bool evaluate(Orbit const& orbit, double far, vector<glm::vec3>& verts) {
+        ClosedOrbit closed;
+        verts.clear();
+        if (!closedForm(orbit, closed)) return false;
+
+        double ue = orbit.Rs / far;
+        if (orbit.u0 < ue) return true;
+
+        double end = closed.exit(ue);
+        int n = max((int)ceil(end / hmax), 1);
+        verts.reserve(n + 1);
+        for (int i = 0; i <= n; ++i) {
+            double phi = end * i / n;
+            Vector3d pos = orbit.at(std::max(closed.u(phi), ue), phi);
+            verts.emplace_back(pos.x(), pos.y(), pos.z());
+        }
+        return true;
+    }
+
+    // Closed-form counterpart of integrate(): orbits are evaluated
+    // independently, and the ones without a closed form are handed to the
+    // integrator.
+    vector<vector<glm::vec3>> evaluate(vector<Orbit> const& orbits, double far) {
+        int n = orbits.size();
+        vector<vector<glm::vec3>> paths(n);
+        vector<char> closed(n);
+        parallelFor(n, [&](int i) -> void {
+            closed[i] = evaluate(orbits[i], far, paths[i]);
+        });
+
+        vector<Orbit> rest;
+        for (int i = 0; i < n; ++i) {
+            if (!closed[i]) rest.push_back(orbits[i]);
+        }
+
+        auto integrated = integrate(rest, far);
+        for (int i = 0, j = 0; i < n; ++i) {
+            if (!closed[i]) paths[i] = move(integrated[j++]);
+        }
+        return paths;
+    }
+
+    // Path of a photon leaving p in the (unit) direction r through the
+    // superposed field of several holes, given as (center, Rs), integrated
+    // with RK4 in
+    //   x'' = sum of -1.5 Rs h^2 (x - c) / |x - c|^5
+    // like the raytracer's marching mode, in steps of `scale` times the
+    // distance to the closest hole. Ends when the photon crosses a horizon or
+    // gets further than `far` from every hole.
+    vector<glm::vec3> superposed(Vector3d p, Vector3d r, vector<Vector4d> const& holes,
+            double far, double scale = 0.01) {
+        auto accel = [&](Vector3d const& x, Vector3d const& v) -> Vector3d {
+            Vector3d a = Vector3d::Zero();
+            for (auto const& hole: holes) {
+                Vector3d d = x - hole.head<3>();
+                double r2 = d.squaredNorm();
+                a -= 1.5 * hole[3] * v.cross(d).squaredNorm() * d / (r2 * r2 * sqrt(r2));
+            }
+            return a;
+        };
+
+        vector<glm::vec3> verts;
+        for (int step = 0; step < maxSteps; ++step) {
+            double dist = INFINITY, ratio = INFINITY;
+            for (auto const& hole: holes) {
+                double d = (p - hole.head<3>()).norm();
+                dist = std::min(dist, d);
+                ratio = std::min(ratio, d / hole[3]);
+            }
+            if (!(ratio > 1 && dist <= far)) break;
+
+            verts.emplace_back(p.x(), p.y(), p.z());
+
+            double ds = scale * dist;
+            Vector3d k1x = r, k1v = accel(p, r);
+            Vector3d k2x = r + ds / 2 * k1v, k2v = accel(p + ds / 2 * k1x, k2x);
+            Vector3d k3x = r + ds / 2 * k2v, k3v = accel(p + ds / 2 * k2x, k3x);
+            Vector3d k4x = r + ds * k3v, k4v = accel(p + ds * k3x, k4x);
+            p += ds / 6 * (k1x + 2 * k2x + 2 * k3x + k4x);
+            r = (r + ds / 6 * (k1v + 2 * k2v + 2 * k3v + k4v)).normalized();
+        }
+
+        return verts;
+    }
+}
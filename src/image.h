@@ -0,0 +1,23 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <stb_image_write.h>
+#include <vector>
+#include <string>
+#include <stdexcept>
+using namespace std;
+using namespace glm;
+
+// Writes an RGBA float image (as produced by the raytracer, first row at the
+// top) to a PNG file.
+void writeImage(string const& path, int w, int h, vector<vec4> const& pixels) {
+    vector<unsigned char> bytes(4 * w * h);
+    for (int i = 0; i < w * h; ++i) {
+        auto c = clamp(pixels[i], 0.0f, 1.0f);
+        for (int j = 0; j < 4; ++j) {
+            bytes[4 * i + j] = (unsigned char)(c[j] * 255.0f + 0.5f);
+        }
+    }
+
+    if (!stbi_write_png(path.c_str(), w, h, 4, bytes.data(), 4 * w))
+        throw runtime_error("Failed to write " + path + ".");
+}
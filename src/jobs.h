@@ -0,0 +1,77 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+using namespace std;
+
+// Runs jobs on a few background threads and keeps their results until the
+// owner picks them up with drain(), e.g. once per frame on the GL thread,
+// which can then do the GL-side work (uploads) for them. Jobs still queued
+// when the pool is destroyed are dropped; running ones are waited for.
+template<typename T>
+class JobPool {
+private:
+    mutex lock;
+    condition_variable wake;
+    deque<function<T()>> queue;
+    vector<T> done;
+    vector<thread> workers;
+    bool stopping = false;
+
+    void work() {
+        while (true) {
+            function<T()> job;
+            {
+                unique_lock<mutex> guard(lock);
+                wake.wait(guard, [this]() -> bool { return stopping || !queue.empty(); });
+                if (stopping) return;
+                job = move(queue.front());
+                queue.pop_front();
+            }
+
+            T result = job();
+
+            lock_guard<mutex> guard(lock);
+            done.push_back(move(result));
+        }
+    }
+
+public:
+    explicit JobPool(int nthreads = 2) {
+        for (int i = 0; i < nthreads; ++i) {
+            workers.emplace_back([this]() -> void { work(); });
+        }
+    }
+
+    ~JobPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+            queue.clear();
+        }
+        wake.notify_all();
+        for (auto& worker: workers) worker.join();
+    }
+
+    JobPool(const JobPool&) = delete;
+    JobPool& operator=(const JobPool&) = delete;
+
+    void submit(function<T()> job) {
+        {
+            lock_guard<mutex> guard(lock);
+            queue.push_back(move(job));
+        }
+        wake.notify_one();
+    }
+
+    // Results of the jobs finished since the last call, in completion order.
+    vector<T> drain() {
+        lock_guard<mutex> guard(lock);
+        vector<T> results;
+        results.swap(done);
+        return results;
+    }
+};
@@ -0,0 +1,286 @@
+#pragma once
+#include <Eigen/Eigen>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "rayapx.h"
+#include "parallel.h"
+using namespace Eigen;
+using namespace std;
+
+// Rotating holes. A hole's spin s = a / M in (-1, 1) is taken about the
+// world y axis, positive for counter-clockwise rotation seen from +y.
+// Impact parameters are in units of Rs = 2M like everywhere else; the
+// formulas below work in units of M.
+namespace kerr {
+    // Critical impact parameter of equatorial photons, in units of Rs. s is
+    // the spin as seen by the photon: positive when it orbits along with the
+    // hole (prograde), negative against it.
+    double bCrit(double s) {
+        return (-s + 6.0 * cos(acos(-s) / 3.0)) / 2.0;
+    }
+
+    // Outer horizon, in units of M.
+    double horizon(double s) {
+        return 1.0 + sqrt(1.0 - s * s);
+    }
+
+    // Gauss-Legendre nodes and weights on [0, 1].
+    struct Quadrature {
+        static constexpr int n = 16;
+        double x[n], w[n];
+
+        Quadrature() {
+            for (int i = 0; i < n; ++i) {
+                double z = cos(M_PI * (i + 0.75) / (n + 0.5)), dp = 1;
+                for (int iter = 0; iter < 100; ++iter) {
+                    double p0 = 1, p1 = 0;
+                    for (int j = 0; j < n; ++j) {
+                        double p2 = p1;
+                        p1 = p0;
+                        p0 = ((2 * j + 1) * z * p1 - j * p2) / (j + 1);
+                    }
+                    dp = n * (z * p0 - p1) / (z * z - 1);
+                    double dz = p0 / dp;
+                    z -= dz;
+                    if (abs(dz) < 1e-15) break;
+                }
+                x[i] = (1 - z) / 2;
+                w[i] = 1 / ((1 - z * z) * dp * dp);
+            }
+        }
+    };
+
+    // Deflection of an equatorial photon with impact parameter b (in Rs)
+    // around a hole of spin s, seen by the photon as in bCrit(). With
+    // u = M / r and b, a in units of M, the orbit obeys
+    //   dphi/du = (b - a + a (1 + (a^2 - a b) u^2) / D(u)) / sqrt(P(u)),
+    //   P(u) = 1 - (b^2 - a^2) u^2 + 2 (b - a)^2 u^3,
+    //   D(u) = 1 - 2 u + a^2 u^2,
+    // which reduces to grav::defl for a = 0. The turning point u0 is the
+    // smallest positive root of P; substituting u = u0 (1 - t^2) removes the
+    // square root singularity there, and the integral is split into
+    // subintervals shrinking towards t = 0, where the integrand peaks for
+    // near-critical photons. Returns NaN for captured photons.
+    double defl(double b, double s) {
+        static const Quadrature quad;
+        double a = s, bm = 2 * b;
+        double beta = bm - a, c = a * a - a * bm;
+        double p2 = -(bm * bm - a * a), p3 = 2 * beta * beta;
+        auto P = [&](double u) -> double { return 1 + u * u * (p2 + u * p3); };
+
+        // P has its minimum over u > 0 at 2 |p2| / (3 p3).
+        double uMin = -2 * p2 / (3 * p3);
+        if (!(P(uMin) < 0)) return NAN;
+
+        double lo = 0, hi = uMin;
+        for (int iter = 0; iter < 100; ++iter) {
+            double mid = (lo + hi) / 2;
+            (P(mid) > 0 ? lo : hi) = mid;
+        }
+        double u0 = lo;
+
+        // P(u) = (u0 - u) Q(u), by synthetic division.
+        double q1 = p2 + u0 * p3, q0 = u0 * q1;
+        auto integrand = [&](double t) -> double {
+            double u = u0 * (1 - t * t);
+            double Q = -(p3 * u * u + q1 * u + q0);
+            double D = 1 - 2 * u + a * a * u * u;
+            double F = beta + a * (1 + c * u * u) / D;
+            return 2 * sqrt(u0) * F / sqrt(Q);
+        };
+
+        double total = 0, hiT = 1;
+        for (int seg = 0; seg < 48; ++seg) {
+            double loT = seg == 47 ? 0 : hiT / 2;
+            for (int i = 0; i < Quadrature::n; ++i) {
+                total += (hiT - loT) * quad.w[i] * integrand(loT + (hiT - loT) * quad.x[i]);
+            }
+            hiT = loT;
+        }
+
+        return 2 * total - M_PI;
+    }
+
+    // Weak-field deflection, grav::deflWeak plus the two leading spin terms.
+    double deflFar(double b, double s) {
+        return grav::deflWeak(b) - s / (b * b) - 1.25 * M_PI * s / (b * b * b);
+    }
+
+    // Photon state in Boyer-Lindquist coordinates, with covariant momenta
+    // p_r, p_theta; the energy is 1 and L = p_phi is conserved.
+    using State = Matrix<double, 5, 1>;  // r, theta, phi, p_r, p_theta
+
+    // Hamilton's equations for H = N / (2 Sigma), with
+    //   N = Delta p_r^2 + p_theta^2 + (L / sin - a sin)^2
+    //       - (r^2 + a^2 - a L)^2 / Delta.
+    State derivs(State const& y, double a, double L) {
+        double r = y[0], th = y[1], pr = y[3], pth = y[4];
+        double sn = sin(th), cs = cos(th);
+        double sigma = r * r + a * a * cs * cs;
+        double delta = r * r - 2 * r + a * a;
+        double A = r * r + a * a - a * L, B = L / sn - a * sn;
+        double N = delta * pr * pr + pth * pth + B * B - A * A / delta;
+
+        double dNdr = (2 * r - 2) * pr * pr
+            - (4 * r * A * delta - A * A * (2 * r - 2)) / (delta * delta);
+        double dNdth = 2 * B * (-L * cs / (sn * sn) - a * cs);
+        double dSdth = -2 * a * a * sn * cs;
+
+        State dy;
+        dy[0] = delta * pr / sigma;
+        dy[1] = pth / sigma;
+        dy[2] = (B / sn + a * A / delta) / sigma;
+        dy[3] = -(dNdr / (2 * sigma) - N * r / (sigma * sigma));
+        dy[4] = -(dNdth / (2 * sigma) - N * dSdth / (2 * sigma * sigma));
+        return dy;
+    }
+
+    // World direction of the hole's (BL) x, y and z axes: z is the spin axis.
+    inline Vector3d toWorld(Vector3d const& v) {
+        return Vector3d(v.x(), v.z(), -v.y());
+    }
+
+    inline Vector3d fromWorld(Vector3d const& v) {
+        return Vector3d(v.x(), -v.z(), v.y());
+    }
+
+    // Path of a photon leaving p in the (unit) direction r, around a hole at
+    // h with Schwarzschild radius Rs and spin s, integrated with RK4 in the
+    // affine parameter, in steps proportional to the distance from the hole.
+    // The starting point is assumed far enough for space to be flat there.
+    // Ends when the photon nears the horizon or gets further than `far`.
+    vector<glm::vec3> trace(Vector3d const& p, Vector3d const& r, Vector3d const& h,
+            double Rs, double s, double far) {
+        static constexpr int maxSteps = 100000;
+        double M = Rs / 2, a = s;
+        double rh = horizon(s), rfar = far / M;
+
+        Vector3d x = fromWorld(p - h) / M, d = fromWorld(r).normalized();
+        double rad = x.norm();
+        double th = acos(std::clamp(x.z() / rad, -1.0, 1.0)), ph = atan2(x.y(), x.x());
+        Vector3d er = x / rad;
+        Vector3d eth(cos(th) * cos(ph), cos(th) * sin(ph), -sin(th));
+        Vector3d eph(-sin(ph), cos(ph), 0);
+
+        double sn = sin(th);
+        double L = rad * sn * d.dot(eph), pth = rad * d.dot(eth);
+        double delta = rad * rad - 2 * rad + a * a;
+        double A = rad * rad + a * a - a * L, B = L / sn - a * sn;
+        double pr2 = (A * A / delta - pth * pth - B * B) / delta;
+        double pr = copysign(sqrt(max(pr2, 0.0)), d.dot(er));
+
+        State y;
+        y << rad, th, ph, pr, pth;
+
+        vector<glm::vec3> verts;
+        for (int step = 0; step < maxSteps; ++step) {
+            double r0 = y[0];
+            if (!(r0 > rh + 1e-2 && r0 <= rfar)) break;
+
+            double rho = sqrt(r0 * r0 + a * a), st = sin(y[1]);
+            Vector3d pos = h + M * toWorld(Vector3d(rho * st * cos(y[2]),
+                rho * st * sin(y[2]), r0 * cos(y[1])));
+            verts.emplace_back(pos.x(), pos.y(), pos.z());
+
+            double dl = 0.01 * max(r0 - rh, 0.05);
+            State k1 = derivs(y, a, L);
+            State k2 = derivs(y + dl / 2 * k1, a, L);
+            State k3 = derivs(y + dl / 2 * k2, a, L);
+            State k4 = derivs(y + dl * k3, a, L);
+            y += dl / 6 * (k1 + 2 * k2 + 2 * k3 + k4);
+        }
+
+        return verts;
+    }
+}
+
+// Deflection of rays by a spinning hole, tabulated over the spin s seen by
+// the ray (the hole's spin times the y component of the ray's unit angular
+// momentum; exact for rays in the equatorial plane) and over
+// z = log(b / bCrit(s) - 1), which keeps the log divergence at the photon
+// sphere linear and lines up the critical points of all rows. Rows are
+// spaced uniformly in the photon orbit radius rather than in s, since the
+// deflection changes much faster with s close to s = 1; lookups interpolate
+// linearly between rows and, within a row, in z. Below the first sample they
+// extrapolate linearly in z, which is the form of the strong deflection
+// limit, and beyond the last one kerr::deflFar takes over. Shared by the
+// compute shader (uploaded as an SSBO) and the CPU raytracer.
+class KerrTable {
+public:
+    static constexpr float spinMax = 0.998f;
+    static constexpr int spins = 65;
+    static constexpr int res = 256;
+    static constexpr float zLow = -11.512925f;  // log(1e-5)
+    static constexpr float zHigh = 3.401197f;  // log(30)
+
+    vector<float> values;
+
+    KerrTable() {
+        values.resize(spins * res);
+        parallelFor(spins, [&](int i) -> void {
+            double s = spin(i), bc = kerr::bCrit(s);
+            for (int j = 0; j < res; ++j) {
+                double z = zLow + j * (double)zStep();
+                values[i * res + j] = kerr::defl(bc * (1 + exp(z)), s);
+            }
+        });
+    }
+
+    KerrTable(const KerrTable&) = delete;
+    KerrTable& operator=(const KerrTable&) = delete;
+
+    // Radius of the circular photon orbit, in units of M, and its inverse.
+    static float photonOrbit(float s) {
+        return 2 * (1 + cos(2 * acos(-s) / 3));
+    }
+
+    static float spinOf(float orbit) {
+        return -cos(1.5f * acos(orbit / 2 - 1));
+    }
+
+    // Orbit radii of the first and last row, and the spacing of the rows.
+    static float orbitLow() {
+        return photonOrbit(spinMax);
+    }
+
+    static float orbitStep() {
+        return (photonOrbit(-spinMax) - orbitLow()) / (float)(spins - 1);
+    }
+
+    static float spin(int row) {
+        return spinOf(orbitLow() + row * orbitStep());
+    }
+
+    static float zStep() {
+        return (zHigh - zLow) / (float)(res - 1);
+    }
+
+    static float bCrit(float s) {
+        return (-s + 6 * cos(acos(-s) / 3)) / 2;
+    }
+
+    // Deflection for b > bCrit(s).
+    float lookup(float b, float s) const {
+        s = std::clamp(s, -spinMax, spinMax);
+        float z = log(b / bCrit(s) - 1);
+        if (z >= zHigh) {
+            return (float)kerr::deflFar(b, s);
+        }
+
+        float x = (z - zLow) / zStep();
+        int idx = min(max((int)x, 0), res - 2);
+        float frac = x - (float)idx;
+
+        float y = (photonOrbit(s) - orbitLow()) / orbitStep();
+        int row = min(max((int)y, 0), spins - 2);
+        float rowFrac = y - (float)row;
+
+        auto at = [&](int row) -> float {
+            float const *v = &values[row * res];
+            return v[idx] + (v[idx + 1] - v[idx]) * frac;
+        };
+        return at(row) + (at(row + 1) - at(row)) * rowFrac;
+    }
+};
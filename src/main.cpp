@@ -12,26 +12,71 @@
 #include "random.h"
 #include "texture.h"
 #include "storage_buffer.h"
+#include "uniform_buffer.h"
+#include "frame.h"
 #include "rayapx.h"
+#include "defl_table.h"
+#include "cpu_raytracer.h"
+#include "kerr.h"
 #include "ray.h"
 #include "scene.h"
+#include "scene_buffers.h"
+#include "image.h"
+#include "batch.h"
+#include "jobs.h"
+#include "profiler.h"
+#include <chrono>
+#include <iostream>
+#include <tuple>
+#include <algorithm>
+#include <cstring>
 
 using namespace std;
 using namespace glm;
 
+void setHoleSpin(Scene& scene, float spin) {
+    for (size_t i = 0; i < scene.holes.size(); ++i) {
+        auto hole = scene.holes[i];
+        hole.spin = spin;
+        scene.updateBody(scene.stars.size() + i, hole);
+    }
+}
+
+// Marching integrates the field of non-rotating holes, so spin only shows
+// when rays are deflected; says so when it gets dropped.
+void warnIgnoredSpin(Scene const& scene, int marchSteps) {
+    bool spinning = any_of(scene.holes.begin(), scene.holes.end(),
+        [](Scene::Body const& hole) -> bool { return hole.spin != 0; });
+    if (spinning && (marchSteps > 0 || scene.holesOverlap())) {
+        cerr << "lens: hole spin is not applied while marching\n";
+    }
+}
+
+// Spacing of the holes of multi-hole scenes, see Scene::setHoles().
+static constexpr float holeSpacing = 3;
+
 class Base {
 public:
     Window window;
     Scene scene;
+    SceneBuffers sceneBufs;
+    UniformBuffer frameBuf;
+    Profiler profiler;
 
     Camera camera;
     bool firstMouse = true;
     float priorX, priorY, priorTime;
     float dt;
-    bool which = true, cursor = false, zone = false;
+    bool which = true, cursor = false, zone = false, deflTex = false;
+    bool closedRays = false, deflSeries = false, march = false, progressive = false;
+    bool reprojection = false;
 
     bool createRay = false;
 
+    // Photon paths are integrated in the background; finished ones are
+    // uploaded by collectRays() on the GL thread.
+    JobPool<vector<vector<glm::vec3>>> rayJobs;
+
     static void onMouseMove(GLFWwindow *window, double x, double y) {
         Base *self = (Base*)glfwGetWindowUserPointer(window);
         if (self->cursor) return;
@@ -77,6 +122,43 @@ public:
         if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
             self->zone = !self->zone;
         }
+
+        if (key == GLFW_KEY_F4 && action == GLFW_PRESS) {
+            self->deflTex = !self->deflTex;
+        }
+
+        if (key == GLFW_KEY_F5 && action == GLFW_PRESS) {
+            self->closedRays = !self->closedRays;
+        }
+
+        if (key == GLFW_KEY_F6 && action == GLFW_PRESS) {
+            self->profiler.report(cout);
+            self->profiler.writeCsv("profile.csv");
+        }
+
+        if (key == GLFW_KEY_F7 && action == GLFW_PRESS) {
+            self->deflSeries = !self->deflSeries;
+        }
+
+        if (key == GLFW_KEY_F8 && action == GLFW_PRESS) {
+            self->cycleSpin();
+        }
+
+        if (key == GLFW_KEY_F9 && action == GLFW_PRESS) {
+            self->march = !self->march;
+        }
+
+        if (key == GLFW_KEY_F10 && action == GLFW_PRESS) {
+            self->cycleHoles();
+        }
+
+        if (key == GLFW_KEY_F11 && action == GLFW_PRESS) {
+            self->progressive = !self->progressive;
+        }
+
+        if (key == GLFW_KEY_F12 && action == GLFW_PRESS) {
+            self->reprojection = !self->reprojection;
+        }
     }
 
     static void onMousePress(GLFWwindow *window, int button, int action, int) {
@@ -84,13 +166,129 @@ public:
 
         if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
             auto& hole = self->scene.holes.front();
-            vector<vec3> stars;
-            for (const auto& star: self->scene.stars) {
-                stars.push_back(star.pos);
+            Vector3d p(self->camera.pos.x, self->camera.pos.y, self->camera.pos.z);
+            Vector3d r(self->camera.front.x, self->camera.front.y, self->camera.front.z);
+
+            if (self->scene.holes.size() > 1) {
+                auto holes = self->holeList();
+                double Rs = self->minHoleRadius();
+                self->rayJobs.submit([=]() -> vector<vector<glm::vec3>> {
+                    return Ray::simplified({ geodesic::superposed(p, r.normalized(), holes, 1000.0) }, Rs);
+                });
+                return;
             }
 
-            self->scene.rays.emplace_back(self->camera.pos, self->camera.front,
-                hole.pos, hole.r, 1000.0);
+            Vector3d h(hole.pos.x, hole.pos.y, hole.pos.z);
+            double Rs = hole.r, spin = hole.spin;
+            bool closed = self->closedRays;
+
+            self->rayJobs.submit([=]() -> vector<vector<glm::vec3>> {
+                vector<glm::vec3> path;
+                if (spin != 0) path = kerr::trace(p, r.normalized(), h, Rs, spin, 1000.0);
+                else if (closed) path = Ray::makeClosedPath(p, r.normalized(), h, Rs, 1000.0);
+                else path = Ray::makePath(p, r.normalized(), h, Rs, 1000.0);
+                return Ray::simplified({ path }, Rs);
+            });
+        }
+
+        if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) {
+            self->spawnFan(10000);
+        }
+    }
+
+    // Shoots n rays from the camera, spread evenly across the vertical field
+    // of view in the camera's horizontal plane, and integrates them as one
+    // batch in the background.
+    void spawnFan(int n) {
+        auto& hole = scene.holes.front();
+        Vector3d p(camera.pos.x, camera.pos.y, camera.pos.z);
+        Vector3d h(hole.pos.x, hole.pos.y, hole.pos.z);
+
+        float half = radians(camera.zoom) / 2;
+        vector<Vector3d> dirs;
+        for (int i = 0; i < n; ++i) {
+            float angle = -half + 2 * half * (float)i / (float)max(n - 1, 1);
+            vec3 dir = camera.front * cos(angle) + cross(camera.up, camera.front) * sin(angle);
+            dirs.push_back(Vector3d(dir.x, dir.y, dir.z).normalized());
+        }
+
+        // Several holes: paths through their superposed field, traced one
+        // by one across threads.
+        if (scene.holes.size() > 1) {
+            auto holes = holeList();
+            double Rs = minHoleRadius();
+            rayJobs.submit([dirs = move(dirs), p, holes, Rs]() -> vector<vector<glm::vec3>> {
+                vector<vector<glm::vec3>> paths(dirs.size());
+                parallelFor(dirs.size(), [&](int i) -> void {
+                    paths[i] = geodesic::superposed(p, dirs[i], holes, 1000.0);
+                });
+                return Ray::simplified(paths, Rs);
+            });
+            return;
+        }
+
+        double Rs = hole.r, spin = hole.spin;
+        bool closed = closedRays;
+
+        // Spinning holes have no batch integrator; their paths are traced
+        // one by one across threads.
+        if (spin != 0) {
+            rayJobs.submit([dirs = move(dirs), p, h, Rs, spin]() -> vector<vector<glm::vec3>> {
+                vector<vector<glm::vec3>> paths(dirs.size());
+                parallelFor(dirs.size(), [&](int i) -> void {
+                    paths[i] = kerr::trace(p, dirs[i], h, Rs, spin, 1000.0);
+                });
+                return Ray::simplified(paths, Rs);
+            });
+            return;
+        }
+
+        vector<geodesic::Orbit> orbits;
+        for (auto const& dir: dirs) {
+            orbits.push_back(geodesic::makeOrbit(p, dir, h, Rs));
+        }
+
+        rayJobs.submit([orbits = move(orbits), Rs, closed]() -> vector<vector<glm::vec3>> {
+            auto paths = closed ? geodesic::evaluate(orbits, 1000.0)
+                : geodesic::integrate(orbits, 1000.0);
+            return Ray::simplified(paths, Rs);
+        });
+    }
+
+    // Holes as (center, Rs), for geodesic::superposed().
+    vector<Vector4d> holeList() const {
+        vector<Vector4d> holes;
+        for (auto const& hole: scene.holes) {
+            holes.emplace_back(hole.pos.x, hole.pos.y, hole.pos.z, hole.r);
+        }
+        return holes;
+    }
+
+    double minHoleRadius() const {
+        double Rs = INFINITY;
+        for (auto const& hole: scene.holes) Rs = std::min(Rs, (double)hole.r);
+        return Rs;
+    }
+
+    // Steps through scenes of 1, 2, 3 and 5 holes.
+    void cycleHoles() {
+        static const int counts[] = { 1, 2, 3, 5 };
+        int i = 0;
+        while (i < 4 && counts[i] != (int)scene.holes.size()) ++i;
+        scene.setHoles(counts[(i + 1) % 4], holeSpacing);
+    }
+
+    // Steps the spin of the holes through a few values, both ways.
+    void cycleSpin() {
+        static const float values[] = { 0, 0.5, 0.9, 0.998, -0.5, -0.9, -0.998 };
+        int i = 0;
+        while (i < 7 && values[i] != scene.holes.front().spin) ++i;
+        setHoleSpin(scene, values[(i + 1) % 7]);
+    }
+
+    void collectRays() {
+        for (auto const& paths: rayJobs.drain()) {
+            scene.rays.emplace_back(paths);
         }
     }
 
@@ -136,12 +334,30 @@ public:
         priorTime = current;
     }
 
+    // Writes the frame constants for a w x h view from the current camera
+    // and binds them for all programs.
+    FrameConstants frameConstants(int w, int h) const {
+        FrameConstants frame(camera, w, h);
+        frame.zone = zone;
+        frame.nstars = scene.stars.size();
+        frame.nholes = scene.holes.size();
+        return frame;
+    }
+
+    void uploadFrame(int w, int h) {
+        auto frame = frameConstants(w, h);
+        frameBuf.update(0, &frame, sizeof(frame));
+        frameBuf.bind(0);
+    }
+
     void refresh() {
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
-    Base() {
+    explicit Base(bool visible = true): window(visible) {
+        frameBuf.load(nullptr, sizeof(FrameConstants));
+
         glfwSetWindowUserPointer(window, this);
         if (!cursor)
             glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -172,6 +388,8 @@ public:
         program = Program({vs, fs});
 
         sphere = Model("res/sphere.obj");
+        sphere.instance(base->sceneBufs.bodies, 3);
+        sphere.instance(base->sceneBufs.colors, 4);
 
         bgColor = vec3(0.1);
     }
@@ -179,30 +397,22 @@ public:
     void render() {
         glUseProgram(program);
 
-        program.set("view", base->camera.view());
         auto [w, h] = base->window.size();
-        program.set("proj", base->camera.proj(w, h));
+        base->uploadFrame(w, h);
 
         glClearColor(bgColor.r, bgColor.g, bgColor.b, 1.0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        auto renderAll = [&](vector<Scene::Body> const& bodies) -> void {
-            for (auto const& [pos, color, r]: bodies) {
-                auto model = mat4(1);
-                model = translate(model, pos);
-                model = scale(model, vec3(r));
-                program.set("model", model);
-                program.set("color", color);
-                sphere.render();
-            }
-        };
+        base->sceneBufs.sync(*scene);
 
-        renderAll(scene->holes);
-        renderAll(scene->stars);
+        auto timer = base->profiler.gpu("normal");
+        sphere.render(scene->buffer.size());
 
+        // Rays don't source the instance attributes from buffers, so they
+        // take these constants instead: no offset, unit scale, white.
+        glVertexAttrib4f(3, 0, 0, 0, 1);
+        glVertexAttrib4f(4, 1, 1, 1, 1);
         for (auto& ray: scene->rays) {
-            program.set("model", mat4(1));
-            program.set("color", vec4(1, 1, 1, 1));
             ray.render();
         }
     }
@@ -213,48 +423,116 @@ private:
     Base *base;
     Scene *scene;
 
-    Texture tex;
+    Texture tex, accumTex;
     ivec2 texSize;
+    // Hit records of the previous frame and of the current one, swapped
+    // after each dispatch.
+    Texture caches[2];
+    int cacheIn = 0;
+    bool cacheValid = false, cacheJittered = false;
+    // Whether every pixel of the cache was traced for its pose, and the
+    // frames reprojected in a row since that was last the case.
+    bool cacheExact = false;
+    int reprojectedFrames = 0;
+    Texture1D deflTex;
 
     Model quad;
 
     Shader quadVs, quadFs, rayComp;
     Program quadProg, rayProg;
-    StorageBuffer bodiesBuf, lowerPartBuf, upperPartBuf, colorBuf;
+
+    Program::Uniform deflUseTexLoc, deflSeriesLoc, marchStepsLoc, marchStepScaleLoc;
+    Program::Uniform maxBouncesLoc, accumulateLoc, sampleIndexLoc, jitterLoc;
+    Program::Uniform reprojectLoc, reprojectRadiusLoc, prevViewProjLoc;
+
+    // Samples accumulated so far, and what they were rendered with.
+    int samples = 0;
+    FrameConstants lastFrame{};
+    tuple<bool, bool, int, float, int> lastSettings;
+    uint64_t lastGeneration = 0;
+
+    StorageBuffer deflBuf;
+    DeflTable defl{DeflTable::defaultCachePath};
+    StorageBuffer kerrBuf;
+    KerrTable kerr;
 
     vec3 bgColor;
 
     void loadDefl() {
-        float lowCutoff = 2.6;
-        float midCutoff = 3;
-        float highCutoff = 10;
-        int lowerRes = 500;
-        int upperRes = 1000;
-
-        rayProg.set("lowCutoff", lowCutoff);
-        rayProg.set("lowerRes", lowerRes);
-        rayProg.set("midCutoff", midCutoff);
-        rayProg.set("upperRes", upperRes);
-        rayProg.set("highCutoff", highCutoff);
-
-        vector<float> lowerPart;
-        for (int i = 0; i < lowerRes; ++i) {
-            float b = lowCutoff + (float)i * (midCutoff - lowCutoff) / (float)lowerRes;
-            lowerPart.push_back(grav::defl(grav::Rapprox(b)));
-        }
-        lowerPartBuf.load(lowerPart.data(), lowerPart.size() * sizeof(float));
-        lowerPartBuf.bind(2);
+        rayProg.set("lowCutoff", defl.lowCutoff);
+        rayProg.set("highCutoff", defl.highCutoff);
+        rayProg.set("deflRes", defl.res);
+        rayProg.set("deflLogLow", defl.logLow());
+        rayProg.set("deflLogStep", defl.logStep());
+
+        deflBuf.load((void*)defl.values, defl.res * sizeof(float));
+        deflBuf.bind(2);
+
+        deflTex = Texture1D(defl.values, defl.res);
+        rayProg.set("deflTex", 1);
+        rayProg.set("deflUseTex", (int)useDeflTex);
+        rayProg.set("deflSeries", (int)useDeflSeries);
+    }
+
+    void loadKerr() {
+        rayProg.set("kerrSpins", KerrTable::spins);
+        rayProg.set("kerrRes", KerrTable::res);
+        rayProg.set("kerrSpinMax", KerrTable::spinMax);
+        rayProg.set("kerrZLow", KerrTable::zLow);
+        rayProg.set("kerrZStep", KerrTable::zStep());
+        rayProg.set("kerrZHigh", KerrTable::zHigh);
+        rayProg.set("kerrOrbitLow", KerrTable::orbitLow());
+        rayProg.set("kerrOrbitStep", KerrTable::orbitStep());
+
+        kerrBuf.load(kerr.values.data(), kerr.values.size() * sizeof(float));
+        kerrBuf.bind(7);
+    }
 
-        vector<float> upperPart;
-        for (int i = 0; i < upperRes; ++i) {
-            float b = midCutoff + (float)i * (highCutoff - midCutoff) / (float)upperRes;
-            upperPart.push_back(grav::defl(grav::Rapprox(b)));
+    static constexpr int maxReprojectRadius = 2;
+    static constexpr int refreshInterval = 30;
+
+    // Pixels by which the images of the bodies may have moved since the last
+    // frame, beyond the change of direction the reprojection accounts for:
+    // the camera's parallax at the closest body, plus one for rounding to
+    // whole pixels. -1 when the motion is too large for reprojection to pay,
+    // and also to trace every pixel again once the camera stops after
+    // reprojected frames, or every refreshInterval of them, since errors of
+    // reprojection would otherwise stay in the cache for good.
+    int reprojectRadius(FrameConstants const& frame, bool moved) const {
+        if (reprojectedFrames >= refreshInterval) return -1;
+        if (!moved && !cacheJittered) return cacheExact ? 0 : -1;
+
+        float dist = INFINITY;
+        for (auto const& body: scene->buffer) {
+            dist = std::min(dist, length(vec3(body) - vec3(frame.pos)) - body.w);
         }
-        upperPartBuf.load(upperPart.data(), upperPart.size() * sizeof(float));
-        upperPartBuf.bind(3);
+        if (!(dist > 0)) return -1;
+
+        float focal = frame.extent.y / (2 * tan(radians(base->camera.zoom) / 2));
+        float parallax = length(vec3(frame.pos - lastFrame.pos)) / dist * focal;
+        int radius = 1 + (int)ceil(parallax);
+        return radius <= maxReprojectRadius ? radius : -1;
     }
 
 public:
+    bool useDeflTex = false;
+    bool useDeflSeries = false;
+    // Step budget per pixel of geodesic marching, 0 to deflect rays once
+    // per hole instead where the scene allows, see Scene::holesOverlap().
+    int marchSteps = 0;
+    float marchStepScale = 0.05f;
+    // Number of times a ray may enter an influence sphere.
+    int maxBounces = 10;
+    // Progressive rendering: while the camera, the scene and the settings
+    // stay the same, each frame adds one jittered sample per pixel to the
+    // image, until maxSamples are in and raytracing stops. Any change starts
+    // over from a single sample.
+    bool progressive = false;
+    int maxSamples = 256;
+    // Reuse the previous frame's hits where they are still valid, see
+    // res/raytracer.comp.
+    bool reprojection = false;
+
     explicit RaytracerMode(Base *base) {
         this->base = base;
         this->scene = &base->scene;
@@ -268,6 +546,17 @@ public:
 
         rayComp = Shader("res/raytracer.comp", GL_COMPUTE_SHADER);
         rayProg = Program({rayComp});
+        deflUseTexLoc = rayProg.uniform("deflUseTex");
+        deflSeriesLoc = rayProg.uniform("deflSeries");
+        marchStepsLoc = rayProg.uniform("marchSteps");
+        marchStepScaleLoc = rayProg.uniform("marchStepScale");
+        maxBouncesLoc = rayProg.uniform("maxBounces");
+        accumulateLoc = rayProg.uniform("accumulate");
+        sampleIndexLoc = rayProg.uniform("sampleIndex");
+        jitterLoc = rayProg.uniform("jitter");
+        reprojectLoc = rayProg.uniform("reproject");
+        reprojectRadiusLoc = rayProg.uniform("reprojectRadius");
+        prevViewProjLoc = rayProg.uniform("prevViewProj");
 
         quad = Model("res/quad.obj");
 
@@ -275,79 +564,231 @@ public:
         glUseProgram(rayProg);
         rayProg.set("bgColor", bgColor);
         loadDefl();
+        loadKerr();
     }
 
-    void render() {
-        glClearColor(bgColor.r, bgColor.g, bgColor.b, 1.0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        auto [w, h] = base->window.size();
+    void trace(int w, int h) {
         ivec2 extent(w, h);
 
         if (texSize != extent) {
             tex = Texture(w, h);
+            accumTex = Texture(w, h);
+            caches[0] = Texture(w, h);
+            caches[1] = Texture(w, h);
             texSize = extent;
+            cacheValid = false;
         }
 
-        glUseProgram(rayProg);
-        tex.bindAsImage(0);
-
-        rayProg.set("pos", base->camera.pos);
-        rayProg.set("extent", extent);
-        rayProg.set("zone", (int)base->zone);
-
-        mat4 mv = base->camera.view(), proj = base->camera.proj(w, h);
-        vec4 viewport(0, 0, w, h);
-
-        vec3 rayLD = unProject(vec3(0, 0, -1), mv, proj, viewport);
-        rayProg.set("rayLD", rayLD);
+        auto frame = base->frameConstants(w, h);
+        // Deflection can't trace scenes with overlapping influence spheres.
+        int steps = marchSteps > 0 || !scene->holesOverlap() ? marchSteps : Scene::overlapMarchSteps;
+        auto settings = make_tuple(useDeflTex, useDeflSeries, steps, marchStepScale, maxBounces);
+        bool moved = memcmp(&frame, &lastFrame, sizeof(frame)) != 0;
+        if (settings != lastSettings || scene->generation != lastGeneration) {
+            warnIgnoredSpin(*scene, steps);
+        }
+        bool changed = settings != lastSettings || scene->generation != lastGeneration ||
+            frame.zone != lastFrame.zone;
+        if (!progressive || moved || changed) {
+            samples = 0;
+        }
 
-        vec3 rayLU = unProject(vec3(0, h, -1), mv, proj, viewport);
-        rayProg.set("rayLU", rayLU);
+        int radius = reprojection && cacheValid && !changed ? reprojectRadius(frame, moved) : -1;
+        mat4 prevViewProj = lastFrame.proj * lastFrame.view;
+        lastFrame = frame;
+        lastSettings = settings;
+        lastGeneration = scene->generation;
+        if (progressive && samples >= maxSamples) return;
 
-        vec3 rayRU = unProject(vec3(w, h, -1), mv, proj, viewport);
-        rayProg.set("rayRU", rayRU);
+        base->uploadFrame(w, h);
 
-        vec3 rayRD = unProject(vec3(w, 0, -1), mv, proj, viewport);
-        rayProg.set("rayRD", rayRD);
+        glUseProgram(rayProg);
+        tex.bindAsImage(0);
+        deflTex.bindAsTex(1);
+        rayProg.set(deflUseTexLoc, (int)useDeflTex);
+        rayProg.set(deflSeriesLoc, (int)useDeflSeries);
+        rayProg.set(marchStepsLoc, steps);
+        rayProg.set(marchStepScaleLoc, marchStepScale);
+        rayProg.set(maxBouncesLoc, maxBounces);
+        rayProg.set(accumulateLoc, (int)progressive);
+        rayProg.set(sampleIndexLoc, samples);
+        rayProg.set(jitterLoc, progressive ? jitterOffset(samples) : vec2(0));
+        if (progressive) accumTex.bindAsImage(1, GL_READ_WRITE);
+        rayProg.set(reprojectLoc, (int)(radius >= 0));
+        rayProg.set(reprojectRadiusLoc, std::max(radius, 0));
+        rayProg.set(prevViewProjLoc, prevViewProj);
+        caches[cacheIn].bindAsImage(2, GL_READ_ONLY);
+        caches[1 - cacheIn].bindAsImage(3);
+
+        base->sceneBufs.sync(*scene);
+        base->sceneBufs.bind();
+
+        auto timer = base->profiler.gpu("raytrace");
+        glDispatchCompute(w / 8 + 1, h / 8 + 1, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
-        int nstars = scene->stars.size();
-        rayProg.set("nstars", nstars);
+        cacheIn = 1 - cacheIn;
+        cacheValid = true;
+        cacheJittered = progressive && samples > 0;
+        cacheExact = radius <= 0;
+        reprojectedFrames = radius > 0 ? reprojectedFrames + 1 : 0;
+        if (progressive) ++samples;
+    }
 
-        int nholes = scene->holes.size();
-        rayProg.set("nholes", nholes);
+    int sampleCount() const {
+        return samples;
+    }
 
-        bodiesBuf.load(scene->buffer.data(), scene->buffer.size() * sizeof(vec4));
-        bodiesBuf.bind(1);
+    vector<vec4> readback() {
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+        vector<vec4> pixels(texSize.x * texSize.y);
+        tex.read(pixels.data());
+        return pixels;
+    }
 
-        colorBuf.load(scene->colorBuffer.data(), scene->colorBuffer.size() * sizeof
-        (vec4));
-        colorBuf.bind(4);
+    void render() {
+        glClearColor(bgColor.r, bgColor.g, bgColor.b, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glDispatchCompute(w / 8 + 1, h / 8 + 1, 1);
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        auto [w, h] = base->window.size();
+        trace(w, h);
 
+        auto timer = base->profiler.gpu("blit");
         glUseProgram(quadProg);
         tex.bindAsTex(0);
         quad.render();
     }
 };
 
-int main() {
+int runBatch(BatchOptions const& opts) {
+    auto poses = loadPoses(opts.posesPath);
+    int w = opts.width, h = opts.height;
+    auto start = chrono::steady_clock::now();
+
+    if (opts.gpu) {
+        Base base(false);
+        RaytracerMode raytracer(&base);
+        raytracer.useDeflTex = opts.deflTexture;
+        raytracer.useDeflSeries = opts.deflSeries;
+        raytracer.marchSteps = opts.marchSteps;
+        raytracer.maxBounces = opts.maxBounces;
+        raytracer.progressive = opts.samples > 1;
+        raytracer.maxSamples = opts.samples;
+        raytracer.reprojection = opts.reproject;
+        base.scene.setHoles(opts.holes, holeSpacing);
+        setHoleSpin(base.scene, opts.spin);
+
+        if (opts.compareDefl) {
+            for (bool useTex: { false, true }) {
+                raytracer.useDeflTex = useTex;
+                base.profiler.clear();
+                for (auto const& [pos, yaw, pitch, zoom]: poses) {
+                    base.camera.setPose(pos, yaw, pitch, zoom);
+                    auto timer = base.profiler.cpu("trace");
+                    for (int s = 0; s < opts.samples; ++s) raytracer.trace(w, h);
+                    raytracer.readback();
+                }
+                glFinish();
+                base.profiler.collect();
+
+                cout << "deflection table in " << (useTex ? "texture" : "SSBO") << ":\n";
+                base.profiler.report(cout);
+            }
+            return 0;
+        }
+
+        for (size_t i = 0; i < poses.size(); ++i) {
+            auto const& [pos, yaw, pitch, zoom] = poses[i];
+            base.camera.setPose(pos, yaw, pitch, zoom);
+            vector<vec4> pixels;
+            {
+                auto timer = base.profiler.cpu("trace");
+                for (int s = 0; s < opts.samples; ++s) raytracer.trace(w, h);
+                pixels = raytracer.readback();
+            }
+            {
+                auto timer = base.profiler.cpu("write");
+                writeImage(opts.framePath(i), w, h, pixels);
+            }
+            base.profiler.collect();
+        }
+
+        base.profiler.report(cout);
+    }
+    else {
+        Scene scene;
+        DeflTable defl(DeflTable::defaultCachePath);
+        KerrTable kerr;
+        CpuRaytracer raytracer(&scene, &defl, &kerr);
+        raytracer.deflSeries = opts.deflSeries;
+        raytracer.marchSteps = opts.marchSteps;
+        raytracer.maxBounces = opts.maxBounces;
+        scene.setHoles(opts.holes, holeSpacing);
+        setHoleSpin(scene, opts.spin);
+        warnIgnoredSpin(scene, opts.marchSteps);
+        Camera camera;
+        Profiler profiler;
+
+        for (size_t i = 0; i < poses.size(); ++i) {
+            auto const& [pos, yaw, pitch, zoom] = poses[i];
+            camera.setPose(pos, yaw, pitch, zoom);
+
+            vector<vec4> pixels;
+            {
+                auto timer = profiler.cpu("trace");
+                pixels = raytracer.render(camera, w, h, opts.samples);
+            }
+            {
+                auto timer = profiler.cpu("write");
+                writeImage(opts.framePath(i), w, h, pixels);
+            }
+        }
+
+        profiler.report(cout);
+    }
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout << "Rendered " << poses.size() << " frames in " << elapsed.count()
+         << " s (" << 1e3 * elapsed.count() / max((size_t)1, poses.size())
+         << " ms/frame)\n";
+    return 0;
+}
+
+int runInteractive() {
     Base base;
 
     NormalMode normal(&base);
     RaytracerMode raytracer(&base);
 
     while (!glfwWindowShouldClose(base.window)) {
+        auto timer = base.profiler.cpu("frame");
         base.updateTime();
         base.onInput();
+        base.collectRays();
 
+        raytracer.useDeflTex = base.deflTex;
+        raytracer.useDeflSeries = base.deflSeries;
+        raytracer.marchSteps = base.march ? 2000 : 0;
+        raytracer.progressive = base.progressive;
+        raytracer.reprojection = base.reprojection;
         if (base.which) normal.render();
         else raytracer.render();
 
+        base.profiler.collect();
         base.refresh();
     }
 
     return 0;
+}
+
+int main(int argc, char **argv) {
+    try {
+        if (BatchOptions::requested(argc, argv))
+            return runBatch(BatchOptions(argc, argv));
+        return runInteractive();
+    }
+    catch (exception const& e) {
+        cerr << "lens: " << e.what() << '\n';
+        return 1;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstddef>
+#include <utility>
+using namespace std;
+
+// Read-only memory mapping of a whole file. An empty (falsy) MappedFile is
+// produced when the file is missing or cannot be mapped.
+class MappedFile {
+private:
+    void *addr = nullptr;
+    size_t len = 0;
+
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const char *path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat st = {};
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *rv = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (rv != MAP_FAILED) {
+                addr = rv;
+                len = st.st_size;
+            }
+        }
+
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (addr) munmap(addr, len);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) {
+        *this = move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) {
+        if (addr) munmap(addr, len);
+        addr = other.addr;
+        len = other.len;
+        other.addr = nullptr;
+        other.len = 0;
+        return *this;
+    }
+
+    const char *data() const {
+        return (const char*)addr;
+    }
+
+    size_t size() const {
+        return len;
+    }
+
+    explicit operator bool() const {
+        return addr != nullptr;
+    }
+};
@@ -62,9 +62,28 @@ public:
         nfaces = faces.size();
     }
 
+    // Sources attribute loc from buf, advancing by one vec4 per instance.
+    void instance(GLuint buf, GLuint loc) {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, buf);
+        glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), nullptr);
+        glEnableVertexAttribArray(loc);
+        glVertexAttribDivisor(loc, 1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
     void render() {
         glBindVertexArray(vao);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idxBuf);
         glDrawElements(GL_TRIANGLES, nfaces, GL_UNSIGNED_INT, nullptr);
     }
+
+    void render(int ninstances) {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idxBuf);
+        glDrawElementsInstanced(GL_TRIANGLES, nfaces, GL_UNSIGNED_INT, nullptr,
+            ninstances);
+    }
 };
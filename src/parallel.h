@@ -0,0 +1,34 @@
+#pragma once
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+inline int workerCount() {
+    return max(1, (int)thread::hardware_concurrency());
+}
+
+// Calls fn(i) for every i in [0, n), handing out indices to a pool of
+// worker threads one at a time, so uneven per-item cost balances out.
+template<typename Fn>
+void parallelFor(int n, Fn const& fn) {
+    int nthreads = min(workerCount(), n);
+    if (nthreads <= 1) {
+        for (int i = 0; i < n; ++i) fn(i);
+        return;
+    }
+
+    atomic<int> next = 0;
+    auto worker = [&]() -> void {
+        for (int i; (i = next++) < n; ) fn(i);
+    };
+
+    vector<thread> threads;
+    for (int t = 1; t < nthreads; ++t) {
+        threads.emplace_back(worker);
+    }
+    worker();
+
+    for (auto& t: threads) t.join();
+}
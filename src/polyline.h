@@ -0,0 +1,53 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <utility>
+using namespace std;
+using namespace glm;
+
+// Distance from p to the segment [a, b].
+float segmentDist(vec3 p, vec3 a, vec3 b) {
+    vec3 ab = b - a;
+    float len2 = dot(ab, ab);
+    float t = len2 > 0 ? glm::clamp(dot(p - a, ab) / len2, 0.0f, 1.0f) : 0.0f;
+    return length(p - (a + t * ab));
+}
+
+// Ramer-Douglas-Peucker simplification: keeps the endpoints and drops every
+// vertex whose removal moves the polyline by at most `tolerance`. Written
+// with an explicit stack, since photon paths can be long.
+vector<vec3> simplify(vector<vec3> const& path, float tolerance) {
+    int n = path.size();
+    if (n <= 2 || tolerance <= 0) return path;
+
+    vector<bool> keep(n, false);
+    keep[0] = keep[n - 1] = true;
+
+    vector<pair<int, int>> stack = { { 0, n - 1 } };
+    while (!stack.empty()) {
+        auto [first, last] = stack.back();
+        stack.pop_back();
+
+        float worst = 0;
+        int worst_i = -1;
+        for (int i = first + 1; i < last; ++i) {
+            float d = segmentDist(path[i], path[first], path[last]);
+            if (d > worst) {
+                worst = d;
+                worst_i = i;
+            }
+        }
+
+        if (worst > tolerance) {
+            keep[worst_i] = true;
+            stack.push_back({ first, worst_i });
+            stack.push_back({ worst_i, last });
+        }
+    }
+
+    vector<vec3> out;
+    for (int i = 0; i < n; ++i) {
+        if (keep[i]) out.push_back(path[i]);
+    }
+    return out;
+}
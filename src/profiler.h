@@ -0,0 +1,207 @@
+#pragma once
+#include <glad/glad.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <utility>
+#include <ostream>
+#include <fstream>
+#include <cstdio>
+using namespace std;
+
+// Rolling window of the latest timings of one section, in milliseconds.
+class Series {
+private:
+    static constexpr size_t window = 256;
+    deque<double> samples;
+
+public:
+    void add(double ms) {
+        samples.push_back(ms);
+        if (samples.size() > window) samples.pop_front();
+    }
+
+    size_t count() const {
+        return samples.size();
+    }
+
+    double mean() const {
+        double sum = 0;
+        for (double ms: samples) sum += ms;
+        return samples.empty() ? 0 : sum / samples.size();
+    }
+
+    // p-th percentile, for p in [0, 1].
+    double percentile(double p) const {
+        if (samples.empty()) return 0;
+        vector<double> sorted(samples.begin(), samples.end());
+        size_t idx = min((size_t)(p * sorted.size()), sorted.size() - 1);
+        nth_element(sorted.begin(), sorted.begin() + idx, sorted.end());
+        return sorted[idx];
+    }
+};
+
+// GPU time of one section, measured with GL_TIME_ELAPSED queries. Results
+// are read a few frames late from a small ring of queries, so that the CPU
+// does not wait for the GPU to catch up unless a section is timed more than
+// `ring` times between two collect() calls; the oldest query is then read
+// back before it is reused, so that no timing is lost.
+class GpuTimer {
+private:
+    static constexpr int ring = 4;
+    GLuint queries[ring] = {};
+    bool issued[ring] = {};
+    int next = 0;
+    vector<double> early;
+
+    double result(int q) {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[q], GL_QUERY_RESULT, &ns);
+        issued[q] = false;
+        return ns * 1e-6;
+    }
+
+public:
+    GpuTimer() {
+        glGenQueries(ring, queries);
+    }
+
+    ~GpuTimer() {
+        glDeleteQueries(ring, queries);
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    // Queries of this kind cannot nest, so neither can sections.
+    void begin() {
+        if (issued[next]) early.push_back(result(next));
+        glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    }
+
+    void end() {
+        glEndQuery(GL_TIME_ELAPSED);
+        issued[next] = true;
+        next = (next + 1) % ring;
+    }
+
+    // Moves the results that are ready into `series`, oldest first.
+    void collect(Series& series) {
+        for (double ms: early) series.add(ms);
+        early.clear();
+
+        for (int i = 0; i < ring; ++i) {
+            int q = (next + i) % ring;
+            if (!issued[q]) continue;
+
+            GLint available = 0;
+            glGetQueryObjectiv(queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) break;
+
+            series.add(result(q));
+        }
+    }
+};
+
+// Named CPU and GPU timings. Sections are timed by scope objects:
+//
+//     { auto t = profiler.cpu("frame"); ... }
+//     { auto t = profiler.gpu("raytrace"); glDispatchCompute(...); }
+//
+// GPU results come in with a delay and are gathered by collect(), once a
+// frame. report() prints rolling statistics, writeCsv() saves them.
+class Profiler {
+private:
+    map<string, Series> cpuTimes, gpuTimes;
+    map<string, GpuTimer> timers;
+
+public:
+    class CpuScope {
+    private:
+        Series *series;
+        chrono::steady_clock::time_point start;
+
+    public:
+        explicit CpuScope(Series *series): series(series) {
+            start = chrono::steady_clock::now();
+        }
+
+        ~CpuScope() {
+            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+            series->add(elapsed.count());
+        }
+
+        CpuScope(const CpuScope&) = delete;
+        CpuScope& operator=(const CpuScope&) = delete;
+    };
+
+    class GpuScope {
+    private:
+        GpuTimer *timer;
+
+    public:
+        explicit GpuScope(GpuTimer *timer): timer(timer) {
+            timer->begin();
+        }
+
+        ~GpuScope() {
+            timer->end();
+        }
+
+        GpuScope(const GpuScope&) = delete;
+        GpuScope& operator=(const GpuScope&) = delete;
+    };
+
+    CpuScope cpu(string const& name) {
+        return CpuScope(&cpuTimes[name]);
+    }
+
+    // Needs a current GL context.
+    GpuScope gpu(string const& name) {
+        return GpuScope(&timers[name]);
+    }
+
+    void collect() {
+        for (auto& [name, timer]: timers) {
+            timer.collect(gpuTimes[name]);
+        }
+    }
+
+    // Drops the statistics gathered so far.
+    void clear() {
+        collect();
+        cpuTimes.clear();
+        gpuTimes.clear();
+    }
+
+    void report(ostream& out) const {
+        char line[128];
+        snprintf(line, sizeof(line), "%-4s %-16s %8s %8s %8s %8s %8s\n",
+            "", "section", "samples", "mean", "p50", "p95", "p99");
+        out << line;
+
+        for (auto const& [kind, times]: { make_pair("cpu", &cpuTimes), make_pair("gpu", &gpuTimes) }) {
+            for (auto const& [name, series]: *times) {
+                snprintf(line, sizeof(line), "%-4s %-16s %8zu %8.3f %8.3f %8.3f %8.3f\n",
+                    kind, name.c_str(), series.count(), series.mean(),
+                    series.percentile(0.5), series.percentile(0.95), series.percentile(0.99));
+                out << line;
+            }
+        }
+    }
+
+    void writeCsv(string const& path) const {
+        ofstream out(path, ios::trunc);
+        out << "kind,section,samples,mean_ms,p50_ms,p95_ms,p99_ms\n";
+        for (auto const& [kind, times]: { make_pair("cpu", &cpuTimes), make_pair("gpu", &gpuTimes) }) {
+            for (auto const& [name, series]: *times) {
+                out << kind << ',' << name << ',' << series.count() << ','
+                    << series.mean() << ',' << series.percentile(0.5) << ','
+                    << series.percentile(0.95) << ',' << series.percentile(0.99) << '\n';
+            }
+        }
+    }
+};
@@ -55,28 +55,47 @@ public:
         }
     }
 
-    void set(const char* var, mat4 const& val) {
-        glUniformMatrix4fv(retrieveLoc(var), 1, GL_FALSE, value_ptr(val));
+    // Location of a uniform resolved ahead of time with uniform(), so that
+    // per-frame set() calls skip the name lookup altogether.
+    struct Uniform {
+        GLint loc = -1;
+    };
+
+    Uniform uniform(const char *var) {
+        return Uniform { retrieveLoc(var) };
     }
 
-    void set(const char *var, vec3 const& val) {
-        glUniform3fv(retrieveLoc(var), 1, value_ptr(val));
+    void set(Uniform var, mat4 const& val) {
+        glUniformMatrix4fv(var.loc, 1, GL_FALSE, value_ptr(val));
     }
 
-    void set(const char *var, int const& val) {
-        glUniform1i(retrieveLoc(var), val);
+    void set(Uniform var, vec3 const& val) {
+        glUniform3fv(var.loc, 1, value_ptr(val));
     }
 
-    void set(const char *var, ivec2 const& val) {
-        glUniform2iv(retrieveLoc(var), 1, value_ptr(val));
+    void set(Uniform var, int const& val) {
+        glUniform1i(var.loc, val);
     }
 
-    void set(const char *var, vec4 const& val) {
-        glUniform4fv(retrieveLoc(var), 1, value_ptr(val));
+    void set(Uniform var, vec2 const& val) {
+        glUniform2fv(var.loc, 1, value_ptr(val));
     }
 
-    void set(const char *var, float const& val) {
-        glUniform1f(retrieveLoc(var), val);
+    void set(Uniform var, ivec2 const& val) {
+        glUniform2iv(var.loc, 1, value_ptr(val));
+    }
+
+    void set(Uniform var, vec4 const& val) {
+        glUniform4fv(var.loc, 1, value_ptr(val));
+    }
+
+    void set(Uniform var, float const& val) {
+        glUniform1f(var.loc, val);
+    }
+
+    template<typename T>
+    void set(const char *var, T const& val) {
+        set(uniform(var), val);
     }
 
     Program(const Program&) = delete;
@@ -1,100 +1,125 @@
 #pragma once
 #include <Eigen/Eigen>
+#include <glm/glm.hpp>
 #include <vector>
 #include <cmath>
 #include "vao.h"
 #include "buffer.h"
+#include "geodesic.h"
+#include "polyline.h"
 using namespace Eigen;
 
+// One or more photon paths, uploaded into a single vertex buffer and drawn
+// as line strips. Only positions are stored, and each path is simplified
+// before upload so that nearly straight stretches cost a couple of vertices.
 class Ray {
 private:
     VAO vao;
     Buffer vertBuf;
-    int nverts;
+    vector<GLint> firsts;
+    vector<GLsizei> counts;
+
+    void upload(vector<vector<glm::vec3>> const& paths) {
+        vector<glm::vec3> verts;
+        for (auto const& path: paths) {
+            if (path.empty()) continue;
+            firsts.push_back(verts.size());
+            counts.push_back(path.size());
+            verts.insert(verts.end(), path.begin(), path.end());
+        }
 
-    vector<Vertex> makePath(Vector3d const& p, Vector3d const& r, Vector3d h,
-            double Rs, double far) {
-        Vector3d d = h - p;
-        Vector3d k = r.cross(d).normalized();
-        Vector3d ray = -d.normalized();
-        double R = d.norm() / Rs;
-
-        double u = 1.0 / R;
-        double cosAlpha = d.dot(r) / d.norm();
-        double sinAlpha = sqrt(1.0 - cosAlpha * cosAlpha);
-        double b = (R * sinAlpha) / sqrt(1.0 - 1.0 / R);
-        double du2 = 1.0 / (b * b) - (1.0 - u) * u * u;
-        Vector2d f(u, sqrt(du2));
-
-        auto df = [&](Vector2d f) -> Vector2d {
-            double du = f.y();
-            double d2u = - f.x() * (1.0 - 1.5 * f.x());
-            return Vector2d(du, d2u);
-        };
-
-        double phi = 0;
-        Vector2d k1, k2, k3, k4;
-        vector<Vertex> verts = {};
-        while (true) {
-            double rad = Rs * 1.0 / f.x();
-            if (rad <= Rs || rad > far) break;
-
-            Vector3d vrot = ray * cos(phi) +
-                            k.cross(ray) * sin(phi) +
-                            k * k.dot(ray) * (1.0 - cos(phi));
-            Vector3d pos = h + rad * vrot;
-
-            Vertex vert;
-            vert.Position.X = pos.x();
-            vert.Position.Y = pos.y();
-            vert.Position.Z = pos.z();
-            verts.push_back(vert);
-
-            for (double delta = 0.01; ; delta /= 2.0) {
-                k1 = df(f);
-                k2 = df(f + (delta / 2.0) * k1);
-                k3 = df(f + (delta / 2.0) * k2);
-                k4 = df(f + delta * k3);
-                auto newF = f + (delta / 6.0) * (k1 + 2.0 * k2 + 2.0 * k3 + k4);
-                auto diff = newF - f;
-                if (diff.x() < 0.1) {
-                    f = newF;
-                    phi += delta;
-                    break;
-                }
-            }
+        glBindVertexArray(vao);
+
+        if (!verts.empty()) {
+            glBindBuffer(GL_ARRAY_BUFFER, vertBuf);
+            glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(glm::vec3),
+                         verts.data(), GL_STATIC_DRAW);
+
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+            glEnableVertexAttribArray(0);
         }
 
-        return verts;
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
     }
 
 public:
+    // Maximum deviation of the drawn paths from the integrated ones, in
+    // Schwarzschild radii of the hole.
+    static constexpr float tolerance = 0.05f;
+
     Ray() = default;
 
-    Ray(vec3 p, vec3 r, vec3 h, double Rs, double far) {
-        auto verts = makePath(Vector3d(p.x, p.y, p.z),
-            Vector3d(r.x, r.y, r.z).normalized(),
-            Vector3d(h.x, h.y, h.z), Rs, far);
+    // Integrates the path of a photon leaving p in the (unit) direction r
+    // around a hole at h. Touches no GL state, so it can run off-thread.
+    static vector<glm::vec3> makePath(Vector3d const& p, Vector3d const& r, Vector3d h,
+            double Rs, double far) {
+        auto orbit = geodesic::makeOrbit(p, r, h, Rs);
+
+        double u = orbit.u0, du = orbit.du0, phi = 0, delta = geodesic::hinit;
+        double ue = Rs / far;
+        vector<glm::vec3> verts = {};
+        while ((int)verts.size() < geodesic::maxSteps) {
+            double rad = Rs * 1.0 / u;
+            if (!(rad > Rs && rad <= far)) break;
+
+            Vector3d pos = orbit.at(u, phi);
+            verts.emplace_back(pos.x(), pos.y(), pos.z());
+
+            while (true) {
+                double newU, newDu, err;
+                geodesic::step(u, du, delta, newU, newDu, err);
+                double taken = delta;
+                delta = geodesic::nextStep(delta, err);
+                if (err <= 1.0 || taken <= geodesic::hmin) {
+                    if (newU < ue) {
+                        // Last step, cut short to end on the far sphere.
+                        taken = geodesic::stepTo(u, du, ue, taken, newU, newDu);
+                        pos = orbit.at(ue, phi + taken);
+                        verts.emplace_back(pos.x(), pos.y(), pos.z());
+                        return verts;
+                    }
+                    u = newU;
+                    du = newDu;
+                    phi += taken;
+                    break;
+                }
+            }
+        }
 
-        nverts = verts.size();
-        glBindVertexArray(vao);
+        return verts;
+    }
 
-        if (nverts > 0) {
-            glBindBuffer(GL_ARRAY_BUFFER, vertBuf);
-            glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(Vertex),
-                         verts.data(), GL_STATIC_DRAW);
+    // Same as makePath(), but evaluates the orbit in closed form when it has
+    // one, see geodesic::evaluate().
+    static vector<glm::vec3> makeClosedPath(Vector3d const& p, Vector3d const& r,
+            Vector3d h, double Rs, double far) {
+        vector<glm::vec3> verts;
+        if (geodesic::evaluate(geodesic::makeOrbit(p, r, h, Rs), far, verts)) {
+            return verts;
+        }
+        return makePath(p, r, h, Rs, far);
+    }
 
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-                                  sizeof(Vertex), (void*)offsetof(Vertex, Position));
-            glEnableVertexAttribArray(0);
+    // Paths around a hole with Schwarzschild radius Rs, simplified to within
+    // `tolerance`. Also safe to call off-thread.
+    static vector<vector<glm::vec3>> simplified(vector<vector<glm::vec3>> const& paths,
+            double Rs) {
+        vector<vector<glm::vec3>> out;
+        for (auto const& path: paths) {
+            out.push_back(simplify(path, tolerance * Rs));
         }
+        return out;
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+    // A bundle of precomputed paths, e.g. from geodesic::integrate(),
+    // uploaded as they are; see simplified().
+    explicit Ray(vector<vector<glm::vec3>> const& paths) {
+        upload(paths);
     }
 
     void render() {
         glBindVertexArray(vao);
-        glDrawArrays(GL_LINE_STRIP, 0, nverts);
+        glMultiDrawArrays(GL_LINE_STRIP, firsts.data(), counts.data(), firsts.size());
     }
-};
\ No newline at end of file
+};
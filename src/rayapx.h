@@ -1,6 +1,8 @@
 #pragma once
 #include <cmath>
 #include <complex>
+#include <algorithm>
+#include "parallel.h"
 
 namespace grav {
     double defl(double R) {
@@ -51,4 +53,137 @@ namespace grav {
     double deflFar(double R) {
         return 2.0 / R;
     }
+
+    // Higher-order expansions taking the impact parameter b directly, so no
+    // R(b) solve is needed. Split at seriesSplit, they stay within 2e-4 of
+    // defl for all b > bCrit, which makes the table optional.
+    constexpr double seriesSplit = 7.0;
+
+    // Weak-field series 2/b + 15pi/16 /b^2 + 16/3 /b^3 + 3465pi/1024 /b^4
+    // + 112/5 /b^5 + 255255pi/16384 /b^6.
+    double deflWeak(double b) {
+        double u = 1.0 / b;
+        return u * (2.0 + u * (15.0 * M_PI / 16.0 + u * (16.0 / 3.0
+            + u * (3465.0 * M_PI / 1024.0 + u * (112.0 / 5.0
+            + u * (255255.0 * M_PI / 16384.0))))));
+    }
+
+    // Strong deflection limit -log(x) + log(216 (7 - 4 sqrt(3))) - pi, with
+    // x = b / bCrit - 1, and corrections in x log x, x, x^2 log x, x^2 and
+    // x^3 fitted by least squares to defl over bCrit < b < seriesSplit.
+    double deflStrong(double b) {
+        static constexpr double bCrit = 2.598076211353316;
+        double x = b / bCrit - 1, l = std::log(x);
+        return -l - 0.40023004 + x * (-0.2752835 * l + 1.2154237
+            + x * (0.1951111 * l - 0.2222020 + x * -0.0361186));
+    }
+
+    double deflSeries(double b) {
+        return b < seriesSplit ? deflStrong(b) : deflWeak(b);
+    }
+
+    // Batch kernels. Inputs are processed in fixed-size blocks with
+    // branch-free, fixed trip count loops, so that the compiler can
+    // vectorize them, and blocks are spread across all cores.
+    namespace batch {
+        constexpr int block = 64;
+
+        // Carlson's symmetric integral R_F(x, y, z) by a fixed number of
+        // duplication steps, followed by the fifth-order series.
+        inline void ellintRF(double *x, double *y, double *z, double *out, int n) {
+            for (int step = 0; step < 16; ++step) {
+                for (int i = 0; i < n; ++i) {
+                    double sx = sqrt(x[i]), sy = sqrt(y[i]), sz = sqrt(z[i]);
+                    double lam = sx * sy + sy * sz + sz * sx;
+                    x[i] = (x[i] + lam) / 4;
+                    y[i] = (y[i] + lam) / 4;
+                    z[i] = (z[i] + lam) / 4;
+                }
+            }
+
+            for (int i = 0; i < n; ++i) {
+                double A = (x[i] + y[i] + z[i]) / 3;
+                double X = 1 - x[i] / A, Y = 1 - y[i] / A, Z = -(X + Y);
+                double E2 = X * Y - Z * Z, E3 = X * Y * Z;
+                out[i] = (1 - E2 / 10 + E3 / 14 + E2 * E2 / 24 - 3 * E2 * E3 / 44) / sqrt(A);
+            }
+        }
+
+        // Newton iteration for the closest approach R(b), started from the
+        // near-critical or the large-b asymptotic estimate (whichever applies),
+        // which are close enough for a fixed number of steps to converge.
+        inline void Rapprox(double const *b, double *R, int n) {
+            for (int i = 0; i < n; ++i) {
+                double b2 = 2 * b[i];
+                double e = sqrt(std::max(b2 * b2 - 27, 0.0)) / 3;
+                double nearR = 3 + e + 4 * e * e / 9;
+                double farR = b2 - 1 - 1.5 / b2;
+                double r = std::max(b2 < 8 ? nearR : farR, 3 + 1e-9);
+
+                for (int iter = 0; iter < 8; ++iter) {
+                    double f = r * r * r / (r - 2) - b2 * b2;
+                    double df = (2 * (r - 3) * r * r) / ((r - 2) * (r - 2));
+                    r -= df > 0 ? f / df : 0;
+                }
+
+                R[i] = r / 2;
+            }
+        }
+
+        // Same formula as grav::defl, with the elliptic integrals expressed
+        // through R_F: K(k) = R_F(0, 1 - k^2, 1) and
+        // F(asin s, k) = s R_F(1 - s^2, 1 - k^2 s^2, 1).
+        inline void defl(double const *R, double *out, int n) {
+            double k2[block], s2[block], x[block], y[block], z[block];
+            double K[block], F[block];
+
+            for (int i = 0; i < n; ++i) {
+                double r = 2 * R[i];
+                double Q = sqrt((r - 2) * (r + 6));
+                k2[i] = (6 + Q - r) / (2 * Q);
+                s2[i] = (2 + Q - r) / (6 + Q - r);
+                out[i] = 4 * sqrt(r / Q);
+            }
+
+            for (int i = 0; i < n; ++i) {
+                x[i] = 0;
+                y[i] = 1 - k2[i];
+                z[i] = 1;
+            }
+            ellintRF(x, y, z, K, n);
+
+            for (int i = 0; i < n; ++i) {
+                x[i] = 1 - s2[i];
+                y[i] = 1 - k2[i] * s2[i];
+                z[i] = 1;
+            }
+            ellintRF(x, y, z, F, n);
+
+            for (int i = 0; i < n; ++i) {
+                out[i] = out[i] * (K[i] - sqrt(s2[i]) * F[i]) - M_PI;
+            }
+        }
+    }
+
+    // Fills R[i] = Rapprox(b[i]) for i in [0, n), in parallel.
+    void Rapprox(double const *b, double *R, int n) {
+        int nblocks = (n + batch::block - 1) / batch::block;
+        parallelFor(nblocks, [&](int blk) -> void {
+            int off = blk * batch::block;
+            batch::Rapprox(b + off, R + off, std::min(batch::block, n - off));
+        });
+    }
+
+    // Fills out[i] = defl(Rapprox(b[i])) for i in [0, n), in parallel. Takes
+    // impact parameters, unlike defl(R), hence the name.
+    void deflOfB(double const *b, float *out, int n) {
+        int nblocks = (n + batch::block - 1) / batch::block;
+        parallelFor(nblocks, [&](int blk) -> void {
+            int off = blk * batch::block, len = std::min(batch::block, n - off);
+            double R[batch::block] = {}, alpha[batch::block];
+            batch::Rapprox(b + off, R, len);
+            batch::defl(R, alpha, len);
+            for (int i = 0; i < len; ++i) out[off + i] = (float)alpha[i];
+        });
+    }
 }
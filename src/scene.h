@@ -2,7 +2,11 @@
 #include <glm/glm.hpp>
 #include "random.h"
 #include "ray.h"
+#include "bvh.h"
 #include <vector>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
 using namespace glm;
 
 class Scene {
@@ -11,13 +15,36 @@ public:
         vec3 pos;
         vec4 color;
         float r;
+        // Holes only: spin a / M about the y axis, see src/kerr.h.
+        float spin;
     };
 
+    // Holes deflect rays entering a sphere this many times their radius.
+    static constexpr float holeInfluence = 50;
+    // Step budget of marching for scenes in which deflection fails, see
+    // holesOverlap().
+    static constexpr int overlapMarchSteps = 2000;
+
     Random rand;
     vector<Ray> rays;
     vector<Body> holes, stars;
     vector<vec4> buffer;
     vector<vec4> colorBuffer;
+    vector<float> spinBuffer;
+    BVH bvh;
+
+    // Changes since the buffers were last uploaded: either the body list
+    // was rebuilt, or the bodies in dirtyBodies were modified and the BVH
+    // nodes in staleNodes refitted, both in ascending order.
+    bool resized = true;
+    vector<int> dirtyBodies, staleNodes;
+    // Bodies moved or resized since the BVH was last refitted.
+    vector<int> moved;
+    // Bumped on every change, for users other than the buffers to tell
+    // whether the scene changed since they last looked at it.
+    uint64_t generation = 0;
+    // Pairs of holes whose influence spheres intersect, see holesOverlap().
+    int overlappingPairs = 0;
 
     vec4 makeColor() {
         float r = rand.uniform(0.75, 1);
@@ -48,14 +75,119 @@ public:
         body.color = vec4(0);
         holes.push_back(body);
 
+        rebuild();
+    }
+
+    // Replaces the holes with n copies of the first one, evenly spaced on a
+    // circle of the given radius facing the camera, around their centroid.
+    // Unless the radius is large against holeInfluence, their influence
+    // spheres overlap, see holesOverlap().
+    void setHoles(int n, float radius) {
+        vec3 center(0);
+        for (auto const& hole: holes) center += hole.pos;
+        center /= (float)holes.size();
+
+        Body first = holes.front();
+        holes.clear();
+        for (int i = 0; i < n; ++i) {
+            float angle = 2 * (float)M_PI * i / n;
+            Body hole = first;
+            hole.pos = n == 1 ? center : center + radius * vec3(cos(angle), sin(angle), 0);
+            holes.push_back(hole);
+        }
+        rebuild();
+    }
+
+    // Regenerates the buffers after bodies were added to or removed from
+    // stars/holes.
+    void rebuild() {
+        buffer.clear();
+        colorBuffer.clear();
+        spinBuffer.clear();
+
         for (auto& star: stars) {
             buffer.emplace_back(star.pos.x, star.pos.y, star.pos.z, star.r);
             colorBuffer.emplace_back(star.color);
+            spinBuffer.push_back(0);
         }
 
         for (auto& hole: holes) {
             buffer.emplace_back(hole.pos.x, hole.pos.y, hole.pos.z, hole.r);
             colorBuffer.emplace_back(hole.color);
+            spinBuffer.push_back(hole.spin);
+        }
+
+        bvh = BVH(buffer, stars.size(), holeInfluence);
+        moved.clear();
+        staleNodes.clear();
+        overlappingPairs = 0;
+        for (size_t k = 0; k < holes.size(); ++k) {
+            overlappingPairs += overlapsWith(k, holes[k].pos, holes[k].r);
+        }
+        overlappingPairs /= 2;
+        resized = true;
+        dirtyBodies.clear();
+        ++generation;
+    }
+
+    // Replaces the i-th body, counting stars first, then holes. Only changes
+    // of position or radius need the BVH refitted.
+    void updateBody(size_t i, Body const& body) {
+        auto& dst = i < stars.size() ? stars[i] : holes[i - stars.size()];
+        if (dst.pos != body.pos || dst.r != body.r) {
+            moved.push_back(i);
+            if (i >= stars.size()) {
+                size_t k = i - stars.size();
+                overlappingPairs += overlapsWith(k, body.pos, body.r) -
+                    overlapsWith(k, dst.pos, dst.r);
+            }
         }
+        dst = body;
+        buffer[i] = vec4(body.pos, body.r);
+        colorBuffer[i] = body.color;
+        spinBuffer[i] = i < stars.size() ? 0 : body.spin;
+
+        auto it = lower_bound(dirtyBodies.begin(), dirtyBodies.end(), (int)i);
+        if (it == dirtyBodies.end() || *it != (int)i) dirtyBodies.insert(it, i);
+        ++generation;
+    }
+
+    // Holes other than the k-th whose influence sphere intersects that of a
+    // hole at pos with radius r.
+    int overlapsWith(size_t k, vec3 pos, float r) const {
+        int count = 0;
+        for (size_t j = 0; j < holes.size(); ++j) {
+            if (j != k && distance(holes[j].pos, pos) < holeInfluence * (holes[j].r + r)) ++count;
+        }
+        return count;
+    }
+
+    // Whether the influence spheres of some holes intersect. Deflection
+    // treats each sphere on its own, and a ray that leaves one inside another
+    // is never deflected by the second, so raytracers march such scenes.
+    bool holesOverlap() const {
+        return overlappingPairs > 0;
+    }
+
+    // Brings the BVH up to date with bodies changed by updateBody().
+    void commit() {
+        if (moved.empty()) return;
+
+        auto touched = bvh.refit(buffer, moved, stars.size(), holeInfluence);
+        vector<int> merged;
+        set_union(staleNodes.begin(), staleNodes.end(), touched.begin(), touched.end(),
+            back_inserter(merged));
+        staleNodes = move(merged);
+        moved.clear();
+    }
+
+    bool dirty() const {
+        return resized || !dirtyBodies.empty();
+    }
+
+    void markClean() {
+        resized = false;
+        dirtyBodies.clear();
+        staleNodes.clear();
     }
 };
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "scene.h"
+#include "storage_buffer.h"
+using namespace glm;
+
+// GPU copies of the scene's body, color, spin and BVH buffers. sync() only
+// transfers what changed since the previous call: nothing for a static
+// scene, runs of modified bodies and of refitted BVH nodes after
+// Scene::updateBody(), and everything after Scene::rebuild().
+class SceneBuffers {
+public:
+    StorageBuffer bodies, colors, spins, nodes, indices;
+
+    void sync(Scene& scene) {
+        if (!scene.dirty()) return;
+        scene.commit();
+
+        auto const& bvh = scene.bvh;
+        if (scene.resized) {
+            bodies.load(scene.buffer.data(), scene.buffer.size() * sizeof(vec4));
+            colors.load(scene.colorBuffer.data(), scene.colorBuffer.size() * sizeof(vec4));
+            spins.load(scene.spinBuffer.data(), scene.spinBuffer.size() * sizeof(float));
+            nodes.load((void*)bvh.nodes.data(), bvh.nodes.size() * sizeof(BVH::Node));
+            indices.load((void*)bvh.indices.data(), bvh.indices.size() * sizeof(int32_t));
+        }
+        else {
+            forRuns(scene.dirtyBodies, [&](int first, int count) -> void {
+                bodies.update(first * sizeof(vec4), &scene.buffer[first], count * sizeof(vec4));
+                colors.update(first * sizeof(vec4), &scene.colorBuffer[first], count * sizeof(vec4));
+                spins.update(first * sizeof(float), &scene.spinBuffer[first], count * sizeof(float));
+            });
+            forRuns(scene.staleNodes, [&](int first, int count) -> void {
+                nodes.update(first * sizeof(BVH::Node), (void*)&bvh.nodes[first],
+                    count * sizeof(BVH::Node));
+            });
+        }
+
+        scene.markClean();
+    }
+
+    // Calls fn(first, count) for each run of consecutive entries of an
+    // ascending list of indices, so that each run is one upload.
+    template<typename Fn>
+    static void forRuns(vector<int> const& sorted, Fn const& fn) {
+        for (size_t i = 0, j; i < sorted.size(); i = j) {
+            for (j = i + 1; j < sorted.size() && sorted[j] == sorted[j - 1] + 1; ++j);
+            fn(sorted[i], j - i);
+        }
+    }
+
+    void bind() {
+        bodies.bind(1);
+        spins.bind(3);
+        colors.bind(4);
+        nodes.bind(5);
+        indices.bind(6);
+    }
+};
@@ -21,6 +21,12 @@ public:
         glBufferData(GL_SHADER_STORAGE_BUFFER, nbytes, data, GL_DYNAMIC_COPY);
     }
 
+    // Overwrites part of the buffer without reallocating it.
+    void update(size_t offset, void *data, size_t nbytes) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, nbytes, data);
+    }
+
     void bind(int n) {
         glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, n, buffer);
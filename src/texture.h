@@ -5,7 +5,7 @@ using namespace std;
 
 class Texture {
 private:
-    GLuint tex;
+    GLuint tex = 0;
 
 public:
     Texture() = default;
@@ -23,8 +23,8 @@ public:
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, nullptr);
     }
 
-    void bindAsImage(int num) {
-        glBindImageTexture(num, tex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    void bindAsImage(int num, GLenum access = GL_WRITE_ONLY) {
+        glBindImageTexture(num, tex, 0, GL_FALSE, 0, access, GL_RGBA32F);
     }
 
     void bindAsTex(int num) {
@@ -32,6 +32,11 @@ public:
         glBindTexture(GL_TEXTURE_2D, tex);
     }
 
+    void read(void *data) {
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, data);
+    }
+
     ~Texture() {
         glDeleteTextures(1, &tex);
     }
@@ -50,6 +55,53 @@ public:
         return *this;
     }
 
+    operator GLuint&() {
+        return tex;
+    }
+};
+
+// Single-channel float lookup table, sampled with linear filtering.
+class Texture1D {
+private:
+    GLuint tex = 0;
+
+public:
+    Texture1D() = default;
+
+    Texture1D(const float *data, int n) {
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_1D, tex);
+
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+        glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, n, 0, GL_RED, GL_FLOAT, data);
+    }
+
+    void bindAsTex(int num) {
+        glActiveTexture(GL_TEXTURE0 + num);
+        glBindTexture(GL_TEXTURE_1D, tex);
+    }
+
+    ~Texture1D() {
+        glDeleteTextures(1, &tex);
+    }
+
+    Texture1D(const Texture1D&) = delete;
+    Texture1D& operator=(const Texture1D&) = delete;
+
+    Texture1D(Texture1D&& other) {
+        *this = move(other);
+    }
+
+    Texture1D& operator=(Texture1D&& other) {
+        glDeleteTextures(1, &tex);
+        tex = other.tex;
+        other.tex = 0;
+        return *this;
+    }
+
     operator GLuint&() {
         return tex;
     }
@@ -0,0 +1,52 @@
+#pragma once
+#include <glad/glad.h>
+#include <utility>
+using namespace std;
+
+class UniformBuffer {
+private:
+    GLuint buffer = 0;
+
+public:
+    UniformBuffer() {
+        glGenBuffers(1, &buffer);
+    }
+
+    ~UniformBuffer() {
+        glDeleteBuffers(1, &buffer);
+    }
+
+    void load(void *data, size_t nbytes) {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, nbytes, data, GL_DYNAMIC_DRAW);
+    }
+
+    // Overwrites part of the buffer without reallocating it.
+    void update(size_t offset, void *data, size_t nbytes) {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, nbytes, data);
+    }
+
+    void bind(int n) {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBindBufferBase(GL_UNIFORM_BUFFER, n, buffer);
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    UniformBuffer(UniformBuffer&& other) {
+        *this = move(other);
+    }
+
+    UniformBuffer& operator=(UniformBuffer&& other) {
+        glDeleteBuffers(1, &buffer);
+        buffer = other.buffer;
+        other.buffer = 0;
+        return *this;
+    }
+
+    operator GLuint&() {
+        return buffer;
+    }
+};
\ No newline at end of file
@@ -13,12 +13,13 @@ private:
     }
 
 public:
-    Window() {
+    explicit Window(bool visible = true) {
         glfwInit();
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
         glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
         glfwWindowHint(GLFW_FLOATING, GLFW_TRUE);
+        glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
         window = glfwCreateWindow(800, 600, "lens", nullptr, nullptr);
         glfwMakeContextCurrent(window);
@@ -0,0 +1,134 @@
+#include "../src/rayapx.h"
+#include "../src/defl_table.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cmath>
+using namespace std;
+
+// Throughput of the deflection kernels, as CSV on stdout (or into the file
+// given as the first argument):
+//
+//     kernel,range,inputs,ns_per_call,calls_per_sec
+//
+// Inputs are drawn with a fixed seed, uniformly in log(b - bCrit) over each
+// range, so runs are comparable across builds and machines.
+
+static constexpr double bCrit = 1.5 * 1.7320508075688772;
+static constexpr int samples = 1 << 16;
+static constexpr double minSeconds = 0.2;
+
+struct Range {
+    const char *name;
+    double lo, hi;
+};
+
+static const Range ranges[] = {
+    { "near", bCrit + 1e-6, 2.6 },
+    { "table", 2.6, 10.0 },
+    { "far", 10.0, 100.0 },
+};
+
+vector<double> sampleB(Range const& range, unsigned seed) {
+    mt19937 gen(seed);
+    uniform_real_distribution<double> dist(log(range.lo - bCrit), log(range.hi - bCrit));
+    vector<double> bs(samples);
+    for (auto& b: bs) b = bCrit + exp(dist(gen));
+    return bs;
+}
+
+// Runs fn over the whole input repeatedly until minSeconds have passed and
+// returns the time per element, in nanoseconds.
+template<typename Fn>
+double measure(Fn const& fn) {
+    using clock = chrono::steady_clock;
+    fn();
+
+    long long calls = 0;
+    auto start = clock::now();
+    chrono::duration<double> elapsed(0);
+    while (elapsed.count() < minSeconds) {
+        fn();
+        calls += samples;
+        elapsed = clock::now() - start;
+    }
+    return 1e9 * elapsed.count() / (double)calls;
+}
+
+volatile double sink;
+
+int main(int argc, char **argv) {
+    ofstream file;
+    if (argc > 1) file.open(argv[1]);
+    ostream& out = argc > 1 ? file : cout;
+
+    DeflTable table;
+    out << "kernel,range,inputs,ns_per_call,calls_per_sec\n";
+
+    auto report = [&](const char *kernel, Range const& range, double ns) -> void {
+        out << kernel << ',' << range.name << ',' << samples << ','
+            << ns << ',' << 1e9 / ns << '\n';
+    };
+
+    for (auto const& range: ranges) {
+        auto bs = sampleB(range, 42);
+        vector<double> Rs(samples);
+        vector<float> angles(samples);
+        for (int i = 0; i < samples; ++i) Rs[i] = grav::Rapprox(bs[i]);
+
+        report("Rapprox", range, measure([&]() -> void {
+            double acc = 0;
+            for (double b: bs) acc += grav::Rapprox(b);
+            sink = acc;
+        }));
+
+        report("Rapprox_batch", range, measure([&]() -> void {
+            grav::Rapprox(bs.data(), Rs.data(), samples);
+            sink = Rs[0];
+        }));
+
+        report("defl", range, measure([&]() -> void {
+            double acc = 0;
+            for (double R: Rs) acc += grav::defl(R);
+            sink = acc;
+        }));
+
+        // Takes b rather than R, so this includes the batch Rapprox.
+        report("defl_batch", range, measure([&]() -> void {
+            grav::deflOfB(bs.data(), angles.data(), samples);
+            sink = angles[0];
+        }));
+
+        report("deflNear", range, measure([&]() -> void {
+            double acc = 0;
+            for (double R: Rs) acc += grav::deflNear(R);
+            sink = acc;
+        }));
+
+        report("deflFar", range, measure([&]() -> void {
+            double acc = 0;
+            for (double R: Rs) acc += grav::deflFar(R);
+            sink = acc;
+        }));
+
+        report("deflSeries", range, measure([&]() -> void {
+            double acc = 0;
+            for (double b: bs) acc += grav::deflSeries(b);
+            sink = acc;
+        }));
+
+        // The table only covers [lowCutoff, highCutoff).
+        if (range.lo >= table.lowCutoff && range.hi <= table.highCutoff) {
+            report("lut", range, measure([&]() -> void {
+                float acc = 0;
+                for (double b: bs) acc += table.lookup((float)b);
+                sink = acc;
+            }));
+        }
+    }
+
+    return 0;
+}
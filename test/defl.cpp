@@ -1,46 +1,204 @@
 #include "../src/rayapx.h"
+#include "../src/defl_table.h"
+#include "../src/kerr.h"
+#include "../src/geodesic.h"
 #include <iostream>
-#include <Eigen/Eigen>
+#include <functional>
 #include <vector>
 #include <cmath>
 using namespace std;
-using namespace Eigen;
 
-class Phi {
-public:
-    double c, k, r0;
+// Checks each regime of the deflection used by the raytracer against the
+// exact grav::defl: deflNear below DeflTable::lowCutoff, the table up to
+// highCutoff and deflFar above it. Fails if an error bound is exceeded, and
+// reports how far each closed-form approximation stays within `target` of
+// the exact value, i.e. where it could replace the table. The higher-order
+// series are checked on their own over the whole range, and the Kerr
+// deflection against the Schwarzschild one, its table and its integrator, as
+// well as the multi-hole integrator and the closed-form orbits.
 
-    Phi(double r0) {
-        this->r0 = r0;
-        c = 2.0 * sqrt(r0) / pow((r0 - 1.0) * (r0 + 3.0), 0.25);
-        k = 1 - (r0 - 3.0) / sqrt((r0 - 1.0) * (r0 + 3.0));
-        k = sqrt(k / 2.0);
-    }
+static constexpr double bCrit = 1.5 * 1.7320508075688772;
+static constexpr double target = 1e-3;
 
-    double operator()(double r) const {
-        double sin2 = 1.0 - (1.0 - 1.0 / r) / (k*k * sqrt((r0 - 1.0) * (r0 + 3.0)));
-        double chi = asin(sqrt(sin2));
-        return c * (comp_ellint_1(k) - ellint_1(k, chi));
-    }
+double exact(double b) {
+    return grav::defl(grav::Rapprox(b));
+}
+
+struct Errors {
+    double max = 0, mean = 0, worstB = 0;
 };
 
-void defl() {
-    for (int n = 0; n < 47; ++n) {
-        double b = 3.0 * sqrt(3) / 2.0 + 10e-14 * pow(2, n);
-        auto Rapx = grav::Rapprox(b);
-        cout << "b = " << b << " -> a = " << grav::defl(Rapx)
-             << "; a' = " << grav::deflNear(Rapx) << '\n';
+// Absolute errors of approx against exact at the given impact parameters.
+Errors errors(vector<double> const& bs, function<double(double)> const& approx) {
+    Errors e;
+    for (double b: bs) {
+        double err = abs(approx(b) - exact(b));
+        e.mean += err;
+        if (err > e.max) {
+            e.max = err;
+            e.worstB = b;
+        }
     }
+    e.mean /= bs.size();
+    return e;
+}
 
-    for (double b = 2.6; b < 25.0; b += 1e-3) {
-        auto Rapx = grav::Rapprox(b);
-        cout << "b = " << b << " -> a = " << grav::defl(Rapx)
-             << "; a' = " << grav::deflFar(Rapx) << '\n';
+// n impact parameters between lo and hi, spaced uniformly in log(b - bCrit).
+vector<double> grid(double lo, double hi, int n) {
+    vector<double> bs(n);
+    double t0 = log(lo - bCrit), t1 = log(hi - bCrit);
+    for (int i = 0; i < n; ++i) {
+        bs[i] = bCrit + exp(t0 + (t1 - t0) * i / (n - 1));
     }
+    return bs;
+}
+
+bool check(const char *name, vector<double> const& bs,
+        function<double(double)> const& approx, double maxBound) {
+    auto e = errors(bs, approx);
+    bool ok = e.max <= maxBound;
+    cout << (ok ? "ok    " : "FAIL  ") << name << ": b in [" << bs.front()
+         << ", " << bs.back() << "], max error " << e.max << " (b = " << e.worstB
+         << ", bound " << maxBound << "), mean error " << e.mean << '\n';
+    return ok;
 }
 
 int main() {
-    cout << 1.49 * sqrt(3);
-    defl();
-    return 0;
+    DeflTable table;
+    bool ok = true;
+
+    auto near = [](double b) -> double { return grav::deflNear(grav::Rapprox(b)); };
+    auto far = [](double b) -> double { return grav::deflFar(grav::Rapprox(b)); };
+    auto lut = [&](double b) -> double { return table.lookup((float)b); };
+
+    ok &= check("deflNear", grid(bCrit + 1e-8, table.lowCutoff, 400), near, 1e-3);
+    // Table lookups take b as a float, so compare at the rounded b.
+    auto tableBs = grid(table.lowCutoff, table.highCutoff, 4000);
+    tableBs.pop_back();
+    for (auto& b: tableBs) b = (float)b;
+    ok &= check("table", tableBs, lut, 1e-4);
+    ok &= check("deflFar", grid(table.highCutoff, 1000, 400), far, 0.03);
+    ok &= check("deflStrong", grid(bCrit + 1e-8, grav::seriesSplit, 2000),
+        grav::deflStrong, 3e-4);
+    ok &= check("deflWeak", grid(grav::seriesSplit, 1000, 2000), grav::deflWeak, 3e-4);
+
+    // Where the approximations alone would be good enough.
+    auto scan = grid(bCrit + 1e-8, 1000, 4000);
+    auto upTo = [&](function<double(double)> const& approx) -> double {
+        double last = scan.front();
+        for (double b: scan) {
+            if (abs(approx(b) - exact(b)) > target) break;
+            last = b;
+        }
+        return last;
+    };
+    auto from = [&](function<double(double)> const& approx) -> double {
+        double last = scan.back();
+        for (auto it = scan.rbegin(); it != scan.rend(); ++it) {
+            if (abs(approx(*it) - exact(*it)) > target) break;
+            last = *it;
+        }
+        return last;
+    };
+
+    cout << "deflNear within " << target << " up to b = " << upTo(near)
+         << " (lowCutoff " << table.lowCutoff << ")\n";
+    cout << "deflStrong within " << target << " up to b = " << upTo(grav::deflStrong) << '\n';
+    cout << "deflFar within " << target << " from b = " << from(far)
+         << " (highCutoff " << table.highCutoff << ")\n";
+    cout << "deflWeak within " << target << " from b = " << from(grav::deflWeak) << '\n';
+
+    // Spinning holes: the quadrature must reduce to grav::defl without spin,
+    // and the table must follow it; the integrator, started far away in
+    // the equatorial plane, must agree with it at both signs of the spin.
+    ok &= check("kerr::defl(s = 0)", grid(bCrit + 1e-6, 100, 400),
+        [](double b) -> double { return kerr::defl(b, 0); }, 1e-5);
+
+    KerrTable kerrTable;
+    double kerrErr = 0;
+    for (int i = 0; i <= 40; ++i) {
+        double s = -0.9 + 1.8 * i / 40;
+        for (double z = -6; z <= 4; z += 0.1) {
+            double b = kerr::bCrit(s) * (1 + exp(z)), ref = kerr::defl(b, s);
+            kerrErr = max(kerrErr, abs(kerrTable.lookup(b, s) - ref) / ref);
+        }
+    }
+    bool kerrOk = kerrErr <= 2e-3;
+    cout << (kerrOk ? "ok    " : "FAIL  ") << "KerrTable: |s| <= 0.9, max relative error "
+         << kerrErr << " (bound 2e-3)\n";
+    ok &= kerrOk;
+
+    for (double s: { -0.9, 0.9 }) {
+        double b = 5;
+        Vector3d h(0, 0, 0), p(-2e4, 0, 2 * b), r(1, 0, 0);
+        auto path = kerr::trace(p, r, h, 2.0, s, 3e4);
+        auto n = path.size();
+        auto d = path[n - 1] - path[n - 2];
+        double err = abs(atan2(-d.z, d.x) - kerr::defl(b, s));
+        bool traceOk = err <= 1e-4;
+        cout << (traceOk ? "ok    " : "FAIL  ") << "kerr::trace: s = " << s << ", b = " << b
+             << ", error " << err << " (bound 1e-4)\n";
+        ok &= traceOk;
+    }
+
+    // The multi-hole integrator must reduce to grav::defl around one hole.
+    {
+        double b = 5;
+        Vector3d p(-2e4, 0, 2 * b), r(1, 0, 0);
+        auto path = geodesic::superposed(p, r, { Vector4d(0, 0, 0, 2) }, 3e4);
+        auto n = path.size();
+        auto d = path[n - 1] - path[n - 2];
+        double err = abs(atan2(-d.z, d.x) - exact(b));
+        bool superposedOk = err <= 1e-4;
+        cout << (superposedOk ? "ok    " : "FAIL  ") << "geodesic::superposed: b = " << b
+             << ", error " << err << " (bound 1e-4)\n";
+        ok &= superposedOk;
+    }
+
+    // Closed-form orbits: the deflection of a photon coming from infinity
+    // (u = 0) must match grav::defl, and the angle swept by an orbit from a
+    // finite distance to the far sphere must match the integrated path.
+    for (double b: { 3.0, 5.0, 20.0 }) {
+        geodesic::Orbit inf;
+        inf.u0 = 0;
+        inf.du0 = 1 / b;
+        geodesic::ClosedOrbit closed;
+        geodesic::closedForm(inf, closed);
+        double deflErr = abs(closed.exit(0) - M_PI - exact(b));
+
+        double far = 3e4;
+        Vector3d h(0, 0, 0), p(-2e4, 0, 2 * b), r(1, 0, 0);
+        auto orbit = geodesic::makeOrbit(p, r, h, 2.0);
+        geodesic::closedForm(orbit, closed);
+        auto path = geodesic::integrate({ orbit }, far)[0];
+        Vector3d first(path.front().x, path.front().y, path.front().z);
+        Vector3d last(path.back().x, path.back().y, path.back().z);
+        double swept = atan2(orbit.k.dot(first.cross(last)), first.dot(last));
+        if (swept < 0) swept += 2 * M_PI;
+        double sweptErr = abs(swept - closed.exit(orbit.Rs / far));
+
+        bool closedOk = deflErr <= 1e-6 && sweptErr <= 1e-5;
+        cout << (closedOk ? "ok    " : "FAIL  ") << "geodesic::closedForm: b = " << b
+             << ", deflection error " << deflErr << " (bound 1e-6), swept angle error "
+             << sweptErr << " (bound 1e-5)\n";
+        ok &= closedOk;
+    }
+
+    // Captured orbits have no closed form and go to the integrator.
+    {
+        double b = 2;
+        Vector3d h(0, 0, 0), p(-2e4, 0, 2 * b), r(1, 0, 0);
+        auto orbit = geodesic::makeOrbit(p, r, h, 2.0);
+        vector<glm::vec3> verts;
+        bool closed = geodesic::evaluate(orbit, 3e4, verts);
+        auto path = geodesic::evaluate(vector<geodesic::Orbit>{ orbit }, 3e4)[0];
+        auto ref = geodesic::integrate({ orbit }, 3e4)[0];
+        double end = glm::length(path.back());
+        bool capturedOk = !closed && verts.empty() && path == ref && end < 2 * orbit.Rs;
+        cout << (capturedOk ? "ok    " : "FAIL  ") << "geodesic::evaluate: captured at b = "
+             << b << ", integrated path ends at r = " << end << '\n';
+        ok &= capturedOk;
+    }
+
+    return ok ? 0 : 1;
 }